@@ -1,14 +1,224 @@
 #pragma once
 
 #include "../core/market_data_simulation_manager.hpp"
+#include "../core/tick_cache.hpp"
 
 #include <clickhouse/client.h>
 
 namespace CRPT::Convenience
 {
     using namespace CRPT::Core;
-    template <class T>
-    concept IsMarketDataUpdate = std::derived_from<T, MarketDataUpdate>;
+
+    // Column-at-a-time decoding of query result blocks. Expected columns, by position:
+    // trades:     id UInt64, symbol LowCardinality(String), price, qty, side Enum8, timestamp DateTime64
+    // L1 updates: id UInt64, symbol LowCardinality(String), bid price, bid qty, ask price, ask qty, timestamp DateTime64
+    // Prices and quantities may be Float32 or Float64.
+    namespace ClickhouseBlockDecoder
+    {
+        // Converts a numeric column into doubles
+        inline void ToDoubles(const clickhouse::ColumnRef &column, std::vector<double> &out)
+        {
+            using namespace clickhouse;
+
+            size_t n = column->Size();
+            out.resize(n);
+            if (auto f32 = column->As<ColumnFloat32>())
+            {
+                for (size_t i = 0; i < n; ++i)
+                    out[i] = (*f32)[i];
+            }
+            else if (auto f64 = column->As<ColumnFloat64>())
+            {
+                for (size_t i = 0; i < n; ++i)
+                    out[i] = (*f64)[i];
+            }
+            else
+                throw std::runtime_error("Column is neither Float32 nor Float64");
+        }
+
+        // Nanoseconds of a DateTime64 column of any precision
+        inline void ToTimestamps(const clickhouse::ColumnRef &column, std::vector<Timestamp> &out)
+        {
+            auto ts = column->As<clickhouse::ColumnDateTime64>();
+            if (!ts)
+                throw std::runtime_error("Column is not DateTime64");
+
+            Timestamp scale = 1;
+            for (size_t precision = ts->GetPrecision(); precision < 9; ++precision)
+                scale *= 10;
+            size_t n = ts->Size();
+            out.resize(n);
+            for (size_t i = 0; i < n; ++i)
+                out[i] = Timestamp(ts->At(i)) * scale;
+        }
+
+        // Maps LowCardinality rows to instrument indices. The strings a LowCardinality column
+        // returns are views of its dictionary, so rows are matched by the address of their entry
+        // and each dictionary entry is converted once per block.
+        template <class Intern>
+        void ToInstrumentIds(const clickhouse::ColumnRef &column, std::vector<u_int32_t> &out, Intern intern)
+        {
+            auto symbols = column->As<clickhouse::ColumnLowCardinalityT<clickhouse::ColumnString>>();
+            if (!symbols)
+                throw std::runtime_error("Column is not LowCardinality(String)");
+
+            std::unordered_map<const char *, u_int32_t> entries;
+            const char *lastEntry = nullptr;
+            u_int32_t lastId = 0;
+            size_t n = symbols->Size();
+            out.resize(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                std::string_view symbol = symbols->At(i);
+                if (symbol.data() != lastEntry)
+                {
+                    auto [it, inserted] = entries.try_emplace(symbol.data(), 0);
+                    if (inserted)
+                        it->second = intern(symbol);
+                    lastEntry = symbol.data();
+                    lastId = it->second;
+                }
+                out[i] = lastId;
+            }
+        }
+
+        inline void ToIds(const clickhouse::ColumnRef &column, std::vector<UpdateId> &out)
+        {
+            auto ids = column->As<clickhouse::ColumnUInt64>();
+            if (!ids)
+                throw std::runtime_error("Column is not UInt64");
+            size_t n = ids->Size();
+            out.resize(n);
+            for (size_t i = 0; i < n; ++i)
+                out[i] = (*ids)[i];
+        }
+
+        inline void ToSides(const clickhouse::ColumnRef &column, std::vector<Side> &out)
+        {
+            auto sides = column->As<clickhouse::ColumnEnum8>();
+            if (!sides)
+                throw std::runtime_error("Column is not Enum8");
+            size_t n = sides->Size();
+            out.resize(n);
+            for (size_t i = 0; i < n; ++i)
+                out[i] = static_cast<Side>(sides->At(i));
+        }
+
+        inline void checkColumns(const clickhouse::Block &block, size_t count)
+        {
+            if (block.GetColumnCount() < count)
+                throw std::runtime_error("Block has " + std::to_string(block.GetColumnCount()) +
+                                         " columns, " + std::to_string(count) + " expected");
+        }
+
+        inline void DecodeTrades(const clickhouse::Block &block, MDTradeColumns &result)
+        {
+            size_t n = block.GetRowCount();
+            if (n == 0)
+                return;
+            checkColumns(block, 6);
+
+            size_t first = result.size();
+            std::vector<UpdateId> ids;
+            std::vector<u_int32_t> instruments;
+            std::vector<double> prices, qtys;
+            std::vector<Side> sides;
+            std::vector<Timestamp> timestamps;
+            ToIds(block[0], ids);
+            ToInstrumentIds(block[1], instruments, [&result](std::string_view symbol)
+                            { return result.InternInstrument(InstrumentPtr(symbol)); });
+            ToDoubles(block[2], prices);
+            ToDoubles(block[3], qtys);
+            ToSides(block[4], sides);
+            ToTimestamps(block[5], timestamps);
+
+            result.reserve(first + n);
+            result.Ids.insert(result.Ids.end(), ids.begin(), ids.end());
+            result.InstrumentIds.insert(result.InstrumentIds.end(), instruments.begin(), instruments.end());
+            result.Prices.insert(result.Prices.end(), prices.begin(), prices.end());
+            result.Qtys.insert(result.Qtys.end(), qtys.begin(), qtys.end());
+            result.AggressorSides.insert(result.AggressorSides.end(), sides.begin(), sides.end());
+            result.EventTimestamps.insert(result.EventTimestamps.end(), timestamps.begin(), timestamps.end());
+        }
+
+        inline void DecodeTrades(const clickhouse::Block &block, std::vector<MDTrade> &result)
+        {
+            size_t n = block.GetRowCount();
+            if (n == 0)
+                return;
+            checkColumns(block, 6);
+
+            std::vector<InstrumentPtr> symbols;
+            std::vector<u_int32_t> instruments;
+            std::vector<UpdateId> ids;
+            std::vector<double> prices, qtys;
+            std::vector<Side> sides;
+            std::vector<Timestamp> timestamps;
+            ToIds(block[0], ids);
+            ToInstrumentIds(block[1], instruments, [&symbols](std::string_view symbol)
+                            {
+                                symbols.emplace_back(symbol);
+                                return u_int32_t(symbols.size() - 1); });
+            ToDoubles(block[2], prices);
+            ToDoubles(block[3], qtys);
+            ToSides(block[4], sides);
+            ToTimestamps(block[5], timestamps);
+
+            size_t first = result.size();
+            result.resize(first + n);
+            MDTrade *trades = result.data() + first;
+            for (size_t i = 0; i < n; ++i)
+            {
+                trades[i].Id = ids[i];
+                trades[i].Price = prices[i];
+                trades[i].Qty = qtys[i];
+                trades[i].AggressorSide = sides[i];
+                trades[i].EventTimestamp = timestamps[i];
+                trades[i].LocalTimestamp = timestamps[i];
+                trades[i].Instrument = symbols[instruments[i]];
+            }
+        }
+
+        inline void DecodeL1Updates(const clickhouse::Block &block, std::vector<MDL1Update> &result)
+        {
+            size_t n = block.GetRowCount();
+            if (n == 0)
+                return;
+            checkColumns(block, 7);
+
+            std::vector<InstrumentPtr> symbols;
+            std::vector<u_int32_t> instruments;
+            std::vector<UpdateId> ids;
+            std::vector<double> bidPrices, bidQtys, askPrices, askQtys;
+            std::vector<Timestamp> timestamps;
+            ToIds(block[0], ids);
+            ToInstrumentIds(block[1], instruments, [&symbols](std::string_view symbol)
+                            {
+                                symbols.emplace_back(symbol);
+                                return u_int32_t(symbols.size() - 1); });
+            ToDoubles(block[2], bidPrices);
+            ToDoubles(block[3], bidQtys);
+            ToDoubles(block[4], askPrices);
+            ToDoubles(block[5], askQtys);
+            ToTimestamps(block[6], timestamps);
+
+            size_t first = result.size();
+            result.resize(first + n);
+            MDL1Update *updates = result.data() + first;
+            for (size_t i = 0; i < n; ++i)
+            {
+                updates[i].Id = ids[i];
+                updates[i].BidPrice = bidPrices[i];
+                updates[i].BidQty = bidQtys[i];
+                updates[i].AskPrice = askPrices[i];
+                updates[i].AskQty = askQtys[i];
+                updates[i].Qty = 0;
+                updates[i].EventTimestamp = timestamps[i];
+                updates[i].LocalTimestamp = timestamps[i];
+                updates[i].Instrument = symbols[instruments[i]];
+            }
+        }
+    }
 
     template <IsMarketDataUpdate T>
     class ClickhouseMarketDataFetcher
@@ -21,66 +231,175 @@ namespace CRPT::Convenience
             const std::string &password,
             const std::string &query)
         {
-            clickhouse::ClientOptions opts;
-            opts.SetHost(host)
-                .SetPort(port)
-                .SetUser(user)
-                .SetPassword(password)
-                .SetDefaultDatabase("default");
-
             std::vector<T> result;
-            clickhouse::Client client(opts);
+            clickhouse::Client client(makeOptions(host, port, user, password));
             client.Select(query,
                           [&result](const clickhouse::Block &block)
                           {
-                              m_process(block, result);
+                              DecodeBlock(block, result);
                           });
 
             return result;
         }
 
-    private:
-        template <IsMarketDataUpdate F>
-        static void m_process(const clickhouse::Block &block, std::vector<F> &result)
+        // Fetch through a local cache: a query already run against the same server is read
+        // from the cache without contacting the server
+        static std::vector<T> Fetch(
+            const std::string &host,
+            unsigned int port,
+            const std::string &user,
+            const std::string &password,
+            const std::string &query,
+            const TickFileCache &cache)
         {
+            std::string key = CacheKey(host, port, user, query);
+            std::vector<T> result;
+            if (cache.Load(key, result))
+                return result;
+            result = Fetch(host, port, user, password, query);
+            // A cache that can't be written doesn't fail the fetch
+            cache.Store(key, result);
+            return result;
         }
-    };
 
-    // GCC doesn't allow method specializations within the class body
-    template <>
-    template <>
-    void ClickhouseMarketDataFetcher<MDTrade>::m_process<MDTrade>(const clickhouse::Block &block, std::vector<MDTrade> &result)
-    {
-        using namespace clickhouse;
-
-        if (block.GetRowCount() == 0)
-            return;
-
-        auto col_id = block[0]->As<ColumnUInt64>();
-        auto col_symbol = block[1]->As<ColumnLowCardinalityT<ColumnString>>();
-        auto col_price = block[2]->As<ColumnFloat32>();
-        auto col_qty = block[3]->As<ColumnFloat32>();
-        auto col_side = block[4]->As<ColumnEnum8>();
-        auto col_ts = block[5]->As<ColumnDateTime64>();
-
-        for (size_t i = 0; i < block.GetRowCount(); ++i)
-        {
-            MDTrade md;
-            md.Id = col_id->At(1);
-            md.Instrument = col_symbol->At(i);
-            md.Price = static_cast<double>(col_price->At(i));
-            md.Qty = static_cast<double>(col_qty->At(i));
-            md.AggressorSide = static_cast<Side>(col_side->At(i));
-            Timestamp ns = col_ts->At(i);
-            md.EventTimestamp = ns;
-            md.LocalTimestamp = ns;
-            result.emplace_back(std::move(md));
+        // The server is identified by its address, user and database; the password isn't part of the key
+        static std::string CacheKey(const std::string &host, unsigned int port, const std::string &user, const std::string &query)
+        {
+            return TickFileCache::Key(host + ":" + std::to_string(port) + "/" + user + "/default/" + ToString(T().Type), query);
         }
-    }
 
-    template <>
-    template <>
-    void ClickhouseMarketDataFetcher<MDL1Update>::m_process<MDL1Update>(const clickhouse::Block &block, std::vector<MDL1Update> &result)
-    {
-    }
-}
\ No newline at end of file
+        // Streaming fetch: blocks are decoded on a background thread while the simulation consumes
+        // the ones already received, at most maxChunks blocks are held in between. The query is
+        // wrapped to be ordered by timestampColumn on the server, leave it empty if the query
+        // already sorts by EventTimestamp. Rewinding the source runs the query again.
+        static MDRowSourcePtr<T> Stream(
+            const std::string &host,
+            unsigned int port,
+            const std::string &user,
+            const std::string &password,
+            const std::string &query,
+            const std::string &timestampColumn = "",
+            size_t maxChunks = 4)
+        {
+            auto options = makeOptions(host, port, user, password);
+            std::string orderedQuery = timestampColumn.empty() ? query : "SELECT * FROM (" + query + ") ORDER BY " + timestampColumn;
+            return std::make_shared<BackgroundMDRowSource<T>>(
+                [options, orderedQuery](const typename BackgroundMDRowSource<T>::Push &push)
+                {
+                    clickhouse::Client client(options);
+                    client.SelectCancelable(orderedQuery,
+                                            [&push](const clickhouse::Block &block)
+                                            {
+                                                std::vector<T> chunk;
+                                                DecodeBlock(block, chunk);
+                                                return push(std::move(chunk));
+                                            });
+                },
+                maxChunks);
+        }
+
+        // Fetch of [start, end) split into time partitions queried over concurrent connections.
+        // Each partition is ordered by the server and the partitions don't overlap, so they are
+        // concatenated in order without a global sort.
+        static std::vector<T> FetchPartitioned(
+            const std::string &host,
+            unsigned int port,
+            const std::string &user,
+            const std::string &password,
+            const std::string &query,
+            const std::string &timestampColumn,
+            Timestamp start,
+            Timestamp end,
+            size_t partitions)
+        {
+            auto ranges = PartitionTimeRange(start, end, partitions);
+            std::vector<std::vector<T>> parts(ranges.size());
+            ParallelFor(ranges.size(), ranges.size(), [&](size_t i)
+                        { parts[i] = Fetch(host, port, user, password,
+                                           PartitionQuery(query, timestampColumn, ranges[i].first, ranges[i].second)); });
+
+            size_t total = 0;
+            for (auto &part : parts)
+                total += part.size();
+            std::vector<T> result;
+            result.reserve(total);
+            for (auto &part : parts)
+            {
+                std::move(part.begin(), part.end(), std::back_inserter(result));
+                std::vector<T>().swap(part);
+            }
+            return result;
+        }
+
+        // Splits [start, end) into at most partitions consecutive non-empty ranges
+        static std::vector<std::pair<Timestamp, Timestamp>> PartitionTimeRange(Timestamp start, Timestamp end, size_t partitions)
+        {
+            std::vector<std::pair<Timestamp, Timestamp>> ranges;
+            if (end <= start)
+                return ranges;
+            partitions = std::max<Timestamp>(1, std::min<Timestamp>(partitions, end - start));
+            Timestamp step = (end - start) / partitions, rest = (end - start) % partitions;
+            for (size_t i = 0; i < partitions; ++i)
+            {
+                Timestamp to = start + step + (i < rest ? 1 : 0);
+                ranges.push_back({start, to});
+                start = to;
+            }
+            return ranges;
+        }
+
+        // The query restricted to EventTimestamps in [from, to) nanoseconds, ordered by them
+        static std::string PartitionQuery(const std::string &query, const std::string &timestampColumn, Timestamp from, Timestamp to)
+        {
+            return "SELECT * FROM (" + query + ") WHERE " + timestampColumn + " >= fromUnixTimestamp64Nano(toInt64(" +
+                   std::to_string(from) + ")) AND " + timestampColumn + " < fromUnixTimestamp64Nano(toInt64(" +
+                   std::to_string(to) + ")) ORDER BY " + timestampColumn;
+        }
+
+        // Trades straight into columns, the instruments are interned once per dictionary entry
+        static MDTradeColumns FetchColumns(
+            const std::string &host,
+            unsigned int port,
+            const std::string &user,
+            const std::string &password,
+            const std::string &query)
+            requires std::same_as<T, MDTrade>
+        {
+            MDTradeColumns result;
+            clickhouse::Client client(makeOptions(host, port, user, password));
+            client.Select(query,
+                          [&result](const clickhouse::Block &block)
+                          {
+                              ClickhouseBlockDecoder::DecodeTrades(block, result);
+                          });
+
+            return result;
+        }
+
+        // Appends the rows of a block, see ClickhouseBlockDecoder for the expected columns
+        static void DecodeBlock(const clickhouse::Block &block, std::vector<T> &result)
+        {
+            if constexpr (std::same_as<T, MDTrade>)
+                ClickhouseBlockDecoder::DecodeTrades(block, result);
+            else if constexpr (std::same_as<T, MDL1Update>)
+                ClickhouseBlockDecoder::DecodeL1Updates(block, result);
+            else
+                static_assert(!sizeof(T), "Data type is not supported");
+        }
+
+    private:
+        static clickhouse::ClientOptions makeOptions(const std::string &host,
+                                                     unsigned int port,
+                                                     const std::string &user,
+                                                     const std::string &password)
+        {
+            clickhouse::ClientOptions opts;
+            opts.SetHost(host)
+                .SetPort(port)
+                .SetUser(user)
+                .SetPassword(password)
+                .SetDefaultDatabase("default");
+            return opts;
+        }
+    };
+}
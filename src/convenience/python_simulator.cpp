@@ -6,6 +6,7 @@
 namespace py = pybind11;
 
 using namespace CRPT::Core;
+using namespace CRPT::Utils;
 
 class PyDataStorage
 {
@@ -27,6 +28,7 @@ public:
             row[i].Qty = qtys[i];
             row[i].AggressorSide = sides[i];
         }
+        MarketDataSorter::Sort(row);
     }
 
     void AddVMDL1Updtes(
@@ -48,6 +50,7 @@ public:
             row[i].BidPrice = bidPrices[i];
             row[i].BidQty = bidQtys[i];
         }
+        MarketDataSorter::Sort(row);
     }
 
     void AddVMDCustomUpdates(
@@ -63,6 +66,7 @@ public:
             row[i].Text = texts[i];
             row[i].Payload = payloads[i];
         }
+        MarketDataSorter::Sort(row);
     }
 
     void AddVMDCustomMultipleUpdates(
@@ -78,31 +82,32 @@ public:
             row[i].Text = texts[i];
             row[i].Payload = payloads[i];
         }
+        MarketDataSorter::Sort(row);
     }
 
     void AddMDTrades(const std::unordered_map<std::string, std::vector<MDTrade>>& trades)
     {
         for(auto& [id, data]: trades)
-            m_trades[id] = data;
+            MarketDataSorter::Sort(m_trades[id] = data);
     }
 
     void AddMDL1Updates(const std::unordered_map<std::string, std::vector<MDL1Update>>& l1Updates)
     {
         for(auto& [id, data]: l1Updates)
-            m_l1_updates[id] = data;
+            MarketDataSorter::Sort(m_l1_updates[id] = data);
     }
 
     void AddMDCustomUpdates(const std::unordered_map<std::string, std::vector<MDCustomUpdate>>& updates)
     {
         for(auto& [id, data]: updates)
-            m_customUpdates[id] = data;
+            MarketDataSorter::Sort(m_customUpdates[id] = data);
     }
 
     void AddMDCustomMultipleUpdates(const std::unordered_map<std::string, std::vector<MDCustomMultipleUpdate>>& updates)
     {
         for(auto& [id, data]: updates)
         {
-            m_customMultipleUpdates[id] = data;
+            MarketDataSorter::Sort(m_customMultipleUpdates[id] = data);
         }
     }
 
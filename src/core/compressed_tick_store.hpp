@@ -0,0 +1,586 @@
+#pragma once
+
+#include "entity.hpp"
+#include "market_data_source.hpp"
+#include "../utils/mapped_file.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Core
+{
+    // Block-compressed tick files.
+    // Layout: CompressedFileHeader, instrument table (u_int32_t length + bytes per name),
+    // blocks (BlockHeader + encoded records), then BlockCount u_int64_t block offsets at IndexOffset.
+    // Records of a block are encoded relative to each other only, so every block decodes on its own:
+    // timestamps as varint delta-of-deltas, local timestamps as deltas of their latency, prices as
+    // varint deltas of PriceScale ticks and quantities as varints of QtyScale ticks. Values that
+    // aren't exact in ticks are escaped as raw doubles.
+    namespace CompressedTickStore
+    {
+        constexpr char MAGIC[8] = {'C', 'R', 'P', 'T', 'C', 'T', 'K', '1'};
+        constexpr u_int32_t VERSION = 1;
+
+        struct CompressedFileHeader
+        {
+            char Magic[8];
+            u_int32_t Version;
+            u_int32_t DataType;
+            u_int64_t RecordCount;
+            u_int64_t BlockCount;
+            u_int64_t InstrumentCount;
+            u_int64_t PriceScale;
+            u_int64_t QtyScale;
+            u_int64_t IndexOffset;
+        };
+
+        struct BlockHeader
+        {
+            Timestamp FirstTimestamp;
+            Timestamp LastTimestamp;
+            u_int64_t FirstRecord;
+            u_int32_t RecordCount;
+            u_int32_t Size;
+        };
+
+        struct Options
+        {
+            u_int64_t PriceScale = 100000000;
+            u_int64_t QtyScale = 100000000;
+            u_int32_t BlockSize = 4096;
+        };
+
+        namespace Encoding
+        {
+            inline void PutVarint(std::string &out, u_int64_t value)
+            {
+                while (value >= 0x80)
+                {
+                    out.push_back(char(value | 0x80));
+                    value >>= 7;
+                }
+                out.push_back(char(value));
+            }
+
+            // Decoders read up to end, the end of the block, and throw past it
+            inline u_int64_t GetVarint(const char *&cursor, const char *end)
+            {
+                u_int64_t value = 0;
+                for (int shift = 0;; shift += 7)
+                {
+                    if (cursor == end || shift > 63)
+                        throw std::runtime_error("Compressed tick block is corrupted");
+                    u_int8_t byte = *cursor++;
+                    value |= u_int64_t(byte & 0x7f) << shift;
+                    if (byte < 0x80)
+                        return value;
+                }
+            }
+
+            inline const std::string &GetInstrument(const char *&cursor, const char *end, const std::vector<std::string> &instruments)
+            {
+                u_int64_t instrument = GetVarint(cursor, end);
+                if (instrument >= instruments.size())
+                    throw std::runtime_error("Compressed tick block refers to unknown instrument " + std::to_string(instrument));
+                return instruments[instrument];
+            }
+
+            inline u_int64_t ZigZag(int64_t value)
+            {
+                return (u_int64_t(value) << 1) ^ u_int64_t(value >> 63);
+            }
+
+            inline int64_t UnZigZag(u_int64_t value)
+            {
+                return int64_t(value >> 1) ^ -int64_t(value & 1);
+            }
+
+            inline void PutDouble(std::string &out, double value)
+            {
+                out.append((const char *)&value, sizeof(value));
+            }
+
+            inline double GetDouble(const char *&cursor, const char *end)
+            {
+                if (end - cursor < std::ptrdiff_t(sizeof(double)))
+                    throw std::runtime_error("Compressed tick block is corrupted");
+                double value;
+                std::memcpy(&value, cursor, sizeof(value));
+                cursor += sizeof(value);
+                return value;
+            }
+
+            // Ticks of value if it is exactly ticks / scale
+            inline bool ToTicks(double value, u_int64_t scale, int64_t &ticks)
+            {
+                double scaled = value * double(scale);
+                if (!(std::abs(scaled) < double(1ll << 60)))
+                    return false;
+                ticks = std::llround(scaled);
+                return double(ticks) / double(scale) == value;
+            }
+
+            // Delta of value against the previous ticks, low bit set for an escaped double
+            inline void PutPrice(std::string &out, double value, u_int64_t scale, int64_t &previous)
+            {
+                int64_t ticks;
+                if (ToTicks(value, scale, ticks))
+                {
+                    PutVarint(out, ZigZag(ticks - previous) << 1);
+                    previous = ticks;
+                }
+                else
+                {
+                    PutVarint(out, 1);
+                    PutDouble(out, value);
+                }
+            }
+
+            inline double GetPrice(const char *&cursor, const char *end, u_int64_t scale, int64_t &previous)
+            {
+                u_int64_t field = GetVarint(cursor, end);
+                if (field & 1)
+                    return GetDouble(cursor, end);
+                previous += UnZigZag(field >> 1);
+                return double(previous) / double(scale);
+            }
+
+            // Quantity with tag extra bits below it and an escape bit
+            inline void PutQty(std::string &out, double value, u_int64_t scale, u_int64_t tag = 0, int tagBits = 0)
+            {
+                int64_t ticks;
+                if (ToTicks(value, scale, ticks))
+                    PutVarint(out, (((ZigZag(ticks) << tagBits) | tag) << 1));
+                else
+                {
+                    PutVarint(out, (tag << 1) | 1);
+                    PutDouble(out, value);
+                }
+            }
+
+            inline double GetQty(const char *&cursor, const char *end, u_int64_t scale, u_int64_t &tag, int tagBits = 0)
+            {
+                u_int64_t field = GetVarint(cursor, end);
+                bool escaped = field & 1;
+                field >>= 1;
+                tag = field & ((1ull << tagBits) - 1);
+                if (escaped)
+                    return GetDouble(cursor, end);
+                return double(UnZigZag(field >> tagBits)) / double(scale);
+            }
+        }
+
+        // Running state of the records of a block
+        struct BlockState
+        {
+            Timestamp PreviousTimestamp{0};
+            int64_t PreviousDelta{0};
+            UpdateId PreviousId{0};
+            int64_t PreviousLatency{0};
+            int64_t PreviousPrices[2]{0, 0};
+
+            void Reset(Timestamp firstTimestamp)
+            {
+                *this = BlockState();
+                PreviousTimestamp = firstTimestamp;
+            }
+
+            void PutHeader(std::string &out, const MarketDataUpdate &update, Timestamp localTimestamp)
+            {
+                using namespace Encoding;
+                int64_t delta = int64_t(update.EventTimestamp - PreviousTimestamp);
+                PutVarint(out, ZigZag(delta - PreviousDelta));
+                PutVarint(out, ZigZag(int64_t(update.Id - PreviousId)));
+                int64_t latency = int64_t(localTimestamp - update.EventTimestamp);
+                PutVarint(out, ZigZag(latency - PreviousLatency));
+                PreviousLatency = latency;
+                PreviousTimestamp = update.EventTimestamp;
+                PreviousDelta = delta;
+                PreviousId = update.Id;
+            }
+
+            void GetHeader(const char *&cursor, const char *end, MarketDataUpdate &update, Timestamp &localTimestamp)
+            {
+                using namespace Encoding;
+                PreviousDelta += UnZigZag(GetVarint(cursor, end));
+                PreviousTimestamp += PreviousDelta;
+                PreviousId += UnZigZag(GetVarint(cursor, end));
+                update.EventTimestamp = PreviousTimestamp;
+                update.Id = PreviousId;
+                PreviousLatency += UnZigZag(GetVarint(cursor, end));
+                localTimestamp = PreviousTimestamp + PreviousLatency;
+            }
+        };
+
+        template <class T>
+        struct Codec;
+
+        template <>
+        struct Codec<MDTrade>
+        {
+            static constexpr MarketDataType Type = MarketDataType::Trade;
+
+            static void Encode(std::string &out, BlockState &state, const CompressedFileHeader &header,
+                               const MDTrade &trade, u_int32_t instrument)
+            {
+                using namespace Encoding;
+                state.PutHeader(out, trade, trade.LocalTimestamp);
+                PutPrice(out, trade.Price, header.PriceScale, state.PreviousPrices[0]);
+                PutQty(out, trade.Qty, header.QtyScale, u_int64_t(trade.AggressorSide), 1);
+                PutVarint(out, instrument);
+            }
+
+            static void Decode(const char *&cursor, const char *end, BlockState &state, const CompressedFileHeader &header,
+                               const std::vector<std::string> &instruments, MDTrade &trade)
+            {
+                using namespace Encoding;
+                state.GetHeader(cursor, end, trade, trade.LocalTimestamp);
+                trade.Price = GetPrice(cursor, end, header.PriceScale, state.PreviousPrices[0]);
+                u_int64_t side;
+                trade.Qty = GetQty(cursor, end, header.QtyScale, side, 1);
+                trade.AggressorSide = Side(side);
+                trade.Instrument = GetInstrument(cursor, end, instruments);
+            }
+        };
+
+        template <>
+        struct Codec<MDL1Update>
+        {
+            static constexpr MarketDataType Type = MarketDataType::L1Update;
+
+            static void Encode(std::string &out, BlockState &state, const CompressedFileHeader &header,
+                               const MDL1Update &update, u_int32_t instrument)
+            {
+                using namespace Encoding;
+                state.PutHeader(out, update, update.LocalTimestamp);
+                PutPrice(out, update.BidPrice, header.PriceScale, state.PreviousPrices[0]);
+                PutPrice(out, update.AskPrice, header.PriceScale, state.PreviousPrices[1]);
+                PutQty(out, update.BidQty, header.QtyScale);
+                PutQty(out, update.AskQty, header.QtyScale);
+                PutQty(out, update.Qty, header.QtyScale);
+                PutVarint(out, instrument);
+            }
+
+            static void Decode(const char *&cursor, const char *end, BlockState &state, const CompressedFileHeader &header,
+                               const std::vector<std::string> &instruments, MDL1Update &update)
+            {
+                using namespace Encoding;
+                state.GetHeader(cursor, end, update, update.LocalTimestamp);
+                update.BidPrice = GetPrice(cursor, end, header.PriceScale, state.PreviousPrices[0]);
+                update.AskPrice = GetPrice(cursor, end, header.PriceScale, state.PreviousPrices[1]);
+                u_int64_t tag;
+                update.BidQty = GetQty(cursor, end, header.QtyScale, tag);
+                update.AskQty = GetQty(cursor, end, header.QtyScale, tag);
+                update.Qty = GetQty(cursor, end, header.QtyScale, tag);
+                update.Instrument = GetInstrument(cursor, end, instruments);
+            }
+        };
+
+        template <class T>
+        void Write(const std::string &path, const std::vector<T> &data, const Options &options = Options())
+        {
+            if (options.PriceScale == 0 || options.QtyScale == 0 || options.BlockSize == 0)
+                throw std::runtime_error("Scales and block size must be positive");
+
+            CompressedFileHeader header{};
+            std::memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+            header.Version = VERSION;
+            header.DataType = u_int32_t(Codec<T>::Type);
+            header.RecordCount = data.size();
+            header.PriceScale = options.PriceScale;
+            header.QtyScale = options.QtyScale;
+
+            std::vector<std::string> instruments;
+            std::unordered_map<std::string, u_int32_t> index;
+            std::string instrumentTable;
+            for (auto &update : data)
+            {
+                auto [it, inserted] = index.try_emplace(update.Instrument, u_int32_t(instruments.size()));
+                if (inserted)
+                {
+                    instruments.push_back(update.Instrument);
+                    u_int32_t length = update.Instrument.size();
+                    instrumentTable.append((const char *)&length, sizeof(length));
+                    instrumentTable.append(update.Instrument);
+                }
+            }
+            header.InstrumentCount = instruments.size();
+
+            std::ofstream file{path, std::ios::binary};
+            if (!file)
+                throw std::runtime_error("Unable to open " + path);
+            file.write((const char *)&header, sizeof(header));
+            file.write(instrumentTable.data(), instrumentTable.size());
+
+            std::vector<u_int64_t> offsets;
+            u_int64_t offset = sizeof(header) + instrumentTable.size();
+            std::string block;
+            BlockState state;
+            for (size_t first = 0; first < data.size(); first += options.BlockSize)
+            {
+                size_t last = std::min(data.size(), first + options.BlockSize);
+                BlockHeader blockHeader{data[first].EventTimestamp, data[first].EventTimestamp, first, u_int32_t(last - first), 0};
+                for (size_t i = first; i < last; ++i)
+                {
+                    blockHeader.FirstTimestamp = std::min(blockHeader.FirstTimestamp, data[i].EventTimestamp);
+                    blockHeader.LastTimestamp = std::max(blockHeader.LastTimestamp, data[i].EventTimestamp);
+                }
+
+                block.clear();
+                state.Reset(blockHeader.FirstTimestamp);
+                for (size_t i = first; i < last; ++i)
+                    Codec<T>::Encode(block, state, header, data[i], index[data[i].Instrument]);
+                blockHeader.Size = block.size();
+
+                offsets.push_back(offset);
+                file.write((const char *)&blockHeader, sizeof(blockHeader));
+                file.write(block.data(), block.size());
+                offset += sizeof(blockHeader) + block.size();
+            }
+
+            header.BlockCount = offsets.size();
+            header.IndexOffset = offset;
+            file.write((const char *)offsets.data(), offsets.size() * sizeof(u_int64_t));
+            file.seekp(0);
+            file.write((const char *)&header, sizeof(header));
+            if (!file)
+                throw std::runtime_error("Unable to write " + path);
+        }
+
+        inline bool IsCompressedTickFile(const std::string &path)
+        {
+            char magic[sizeof(MAGIC)] = {};
+            std::ifstream file{path, std::ios::binary};
+            file.read(magic, sizeof(magic));
+            return file && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+        }
+
+        // Read-only mapping of a compressed tick file
+        class CompressedTickFile
+        {
+        public:
+            CompressedTickFile(const std::string &path) : m_file(path)
+            {
+                if (m_file.size() < sizeof(CompressedFileHeader))
+                    throw std::runtime_error(path + " is not a compressed tick file");
+
+                std::memcpy(&m_header, m_file.data(), sizeof(m_header));
+                if (std::memcmp(m_header.Magic, MAGIC, sizeof(MAGIC)) != 0 || m_header.Version != VERSION)
+                    throw std::runtime_error(path + " is not a compressed tick file");
+
+                const char *cursor = m_file.data() + sizeof(CompressedFileHeader);
+                const char *end = m_file.data() + m_file.size();
+                for (u_int64_t i = 0; i < m_header.InstrumentCount && cursor + sizeof(u_int32_t) <= end; ++i)
+                {
+                    u_int32_t length;
+                    std::memcpy(&length, cursor, sizeof(length));
+                    cursor += sizeof(length);
+                    if (cursor + length > end)
+                        break;
+                    m_instruments.emplace_back(cursor, length);
+                    cursor += length;
+                }
+                // Sizes are compared by division and subtraction, corrupted counts and offsets
+                // can't overflow the bounds
+                u_int64_t blocksBegin = cursor - m_file.data();
+                if (m_instruments.size() != m_header.InstrumentCount ||
+                    m_header.IndexOffset < blocksBegin || m_header.IndexOffset > m_file.size() ||
+                    m_header.BlockCount > (m_file.size() - m_header.IndexOffset) / sizeof(u_int64_t) ||
+                    (m_header.BlockCount != 0 && m_header.IndexOffset - blocksBegin < sizeof(BlockHeader)))
+                    throw std::runtime_error(path + " is truncated");
+
+                m_offsets.resize(m_header.BlockCount);
+                std::memcpy(m_offsets.data(), m_file.data() + m_header.IndexOffset, m_offsets.size() * sizeof(u_int64_t));
+                u_int64_t records = 0;
+                for (auto offset : m_offsets)
+                {
+                    if (offset < blocksBegin || offset > m_header.IndexOffset - sizeof(BlockHeader))
+                        throw std::runtime_error(path + " has a corrupted block index");
+                    auto block = GetBlockHeader(offset);
+                    if (block.Size > m_header.IndexOffset - sizeof(BlockHeader) - offset)
+                        throw std::runtime_error(path + " is truncated");
+                    if (block.FirstRecord != records)
+                        throw std::runtime_error(path + " has a corrupted block index");
+                    records += block.RecordCount;
+                }
+                if (records != m_header.RecordCount)
+                    throw std::runtime_error(path + " has a corrupted block index");
+            }
+
+            MarketDataType GetDataType() const
+            {
+                return MarketDataType(m_header.DataType);
+            }
+
+            const CompressedFileHeader &GetHeader() const
+            {
+                return m_header;
+            }
+
+            size_t size() const
+            {
+                return m_header.RecordCount;
+            }
+
+            size_t BlockCount() const
+            {
+                return m_offsets.size();
+            }
+
+            BlockHeader GetBlock(size_t block) const
+            {
+                return GetBlockHeader(m_offsets[block]);
+            }
+
+            // Encoded records of the block
+            const char *BlockData(size_t block) const
+            {
+                return m_file.data() + m_offsets[block] + sizeof(BlockHeader);
+            }
+
+            // Index in the file of the first record of the block
+            size_t BlockFirstRecord(size_t block) const
+            {
+                return block < m_offsets.size() ? GetBlock(block).FirstRecord : size();
+            }
+
+            // First block that may hold EventTimestamps >= timestamp, BlockCount() if none
+            size_t FindBlock(Timestamp timestamp) const
+            {
+                size_t first = 0, count = m_offsets.size();
+                while (count > 0)
+                {
+                    size_t step = count / 2;
+                    if (GetBlock(first + step).LastTimestamp < timestamp)
+                    {
+                        first += step + 1;
+                        count -= step + 1;
+                    }
+                    else
+                        count = step;
+                }
+                return first;
+            }
+
+            const std::vector<std::string> &GetInstruments() const
+            {
+                return m_instruments;
+            }
+
+        private:
+            BlockHeader GetBlockHeader(u_int64_t offset) const
+            {
+                BlockHeader header;
+                std::memcpy(&header, m_file.data() + offset, sizeof(header));
+                return header;
+            }
+
+            Utils::MappedFile m_file;
+            CompressedFileHeader m_header;
+            std::vector<std::string> m_instruments;
+            std::vector<u_int64_t> m_offsets;
+        };
+
+        using CompressedTickFilePtr = std::shared_ptr<CompressedTickFile>;
+
+        // Decodes blocks straight from the mapping into the row chunks. With a from timestamp,
+        // blocks ending before it are skipped and so are the earlier records of the first block.
+        template <class T>
+        class CompressedTickSource : public IMDRowSource<T>
+        {
+        public:
+            CompressedTickSource(CompressedTickFilePtr file, Timestamp from = 0) : m_file(file),
+                                                                                  m_from(from)
+            {
+                if (file->GetDataType() != Codec<T>::Type)
+                    throw std::runtime_error("Compressed tick file holds " + ToString(file->GetDataType()) + " records");
+                Rewind();
+            }
+
+            size_t Read(std::vector<T> &chunk, size_t maxSize) override
+            {
+                size_t first = chunk.size();
+                maxSize = std::min(maxSize, m_file->size());
+                chunk.resize(first + maxSize);
+                size_t count = 0;
+                auto &header = m_file->GetHeader();
+                auto &instruments = m_file->GetInstruments();
+                while (count < maxSize && nextBlock())
+                {
+                    size_t n = std::min<size_t>(maxSize - count, m_remaining);
+                    for (size_t i = 0; i < n; ++i)
+                        Codec<T>::Decode(m_cursor, m_end, m_state, header, instruments, chunk[first + count + i]);
+                    m_remaining -= n;
+
+                    // Records before the from timestamp are decoded over
+                    size_t skipped = 0;
+                    if (m_skipping)
+                    {
+                        while (skipped < n && chunk[first + count + skipped].EventTimestamp < m_from)
+                            ++skipped;
+                        if (skipped < n)
+                            m_skipping = false;
+                        std::move(chunk.begin() + first + count + skipped, chunk.begin() + first + count + n,
+                                  chunk.begin() + first + count);
+                    }
+                    count += n - skipped;
+                }
+                chunk.resize(first + count);
+                return count;
+            }
+
+            void Rewind() override
+            {
+                m_block = m_file->FindBlock(m_from);
+                m_remaining = 0;
+                m_started = false;
+                m_skipping = m_from != 0;
+            }
+
+            // Moves to the start of the block holding timestamp, the records before it in the
+            // block are still read. Indexes count from the from timestamp, so only a source
+            // reading the whole file can seek.
+            std::optional<size_t> Seek(Timestamp timestamp) override
+            {
+                if (m_from != 0)
+                    return std::nullopt;
+                m_block = m_file->FindBlock(timestamp);
+                m_remaining = 0;
+                m_started = false;
+                m_skipping = false;
+                return m_file->BlockFirstRecord(m_block);
+            }
+
+        private:
+            // Moves to the next block once the current one is decoded, false at the end of the file
+            bool nextBlock()
+            {
+                if (m_remaining > 0)
+                    return true;
+                if (m_started)
+                    ++m_block;
+                m_started = true;
+                while (m_block < m_file->BlockCount())
+                {
+                    auto block = m_file->GetBlock(m_block);
+                    if (block.RecordCount > 0)
+                    {
+                        m_cursor = m_file->BlockData(m_block);
+                        m_end = m_cursor + block.Size;
+                        m_remaining = block.RecordCount;
+                        m_state.Reset(block.FirstTimestamp);
+                        return true;
+                    }
+                    ++m_block;
+                }
+                return false;
+            }
+
+            CompressedTickFilePtr m_file;
+            Timestamp m_from;
+            size_t m_block{0};
+            size_t m_remaining{0};
+            bool m_started{false}, m_skipping{false};
+            const char *m_cursor{nullptr}, *m_end{nullptr};
+            BlockState m_state;
+        };
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "tick_store.hpp"
+#include "../utils/helpers.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Core
+{
+    // Sidecar tick files caching parsed CSV inputs, stored next to the CSV as
+    // <name>.<schema>.<version>.crptcache. The schema part hashes the schema key, the version
+    // part the absolute path, size and mtime of the CSV and the schema key, so a changed
+    // file or schema simply misses the cache.
+    namespace CSVCache
+    {
+        constexpr const char *EXTENSION = ".crptcache";
+
+        inline std::string Path(const std::string &csvPath, const std::string &schemaKey)
+        {
+            auto path = std::filesystem::absolute(csvPath);
+            auto size = std::filesystem::file_size(path);
+            auto mtime = std::filesystem::last_write_time(path).time_since_epoch().count();
+
+            u_int64_t hash = Utils::Helpers::Hash(path.string());
+            hash = Utils::Helpers::Hash(std::to_string(size) + ":" + std::to_string(mtime) + ":" + schemaKey, hash);
+            return path.string() + "." + Utils::Helpers::ToHex(Utils::Helpers::Hash(schemaKey)) + "." +
+                   Utils::Helpers::ToHex(hash) + EXTENSION;
+        }
+
+        // Appends the cached updates to out, false if there is no usable cache
+        template <class T>
+        bool Load(const std::string &cachePath, std::vector<T> &out)
+        {
+            if (!std::filesystem::exists(cachePath))
+                return false;
+            size_t size = out.size();
+            try
+            {
+                TickStore::Read(cachePath, out);
+                return true;
+            }
+            catch (const std::runtime_error &)
+            {
+                out.resize(size);
+                return false;
+            }
+        }
+
+        // Writes the cache through a temporary file and removes stale versions of it, the
+        // caches of the same CSV and schema key; failures (e.g. a read-only directory) leave
+        // the CSV uncached
+        template <class T>
+        void Store(const std::string &csvPath, const std::string &cachePath, const std::vector<T> &data)
+        {
+            std::error_code ec;
+            auto csv = std::filesystem::absolute(csvPath);
+            std::string cacheName = std::filesystem::path(cachePath).filename().string();
+            size_t versionSize = 16 + std::strlen(EXTENSION);
+            if (cacheName.size() > versionSize)
+            {
+                std::string prefix = cacheName.substr(0, cacheName.size() - versionSize);
+                for (auto &entry : std::filesystem::directory_iterator(csv.parent_path(), ec))
+                {
+                    std::string name = entry.path().filename().string();
+                    if (name.size() == cacheName.size() && name.starts_with(prefix) && name.ends_with(EXTENSION) &&
+                        name != cacheName)
+                        std::filesystem::remove(entry.path(), ec);
+                }
+            }
+
+            std::string tmpPath = cachePath + "." + Utils::Helpers::GetUniqueSuffix() + ".tmp";
+            try
+            {
+                TickStore::Write(tmpPath, data);
+                std::filesystem::rename(tmpPath, cachePath);
+            }
+            catch (const std::exception &)
+            {
+                std::filesystem::remove(tmpPath, ec);
+            }
+        }
+    }
+}
@@ -5,6 +5,9 @@
 namespace CRPT::Core
 {
     constexpr double MAXPRICE = std::numeric_limits<double>::max();
+    constexpr double MAXQTY = std::numeric_limits<double>::max();
+    // Quantities below it are rounding leftovers of fractional quantities and count as zero
+    constexpr double QTY_EPSILON = 1e-9;
 
     using OrderId = uint64_t;
     using Timestamp = uint64_t;
@@ -115,6 +118,8 @@ namespace CRPT::Core
 
     using InstrumentPtr = std::string;
 
+    struct PriceLevel;
+
     struct Order
     {
         OrderId Id;
@@ -132,6 +137,17 @@ namespace CRPT::Core
         Timestamp CreateTimestamp = 0;
         Timestamp LastReportTimestamp = 0;
 
+        // Position and remaining quantity in the book of the OrderExecutionManager while the order rests there
+        PriceLevel *BookLevel = nullptr;
+        double BookQty = 0;
+        // With the queue position model, the consumed market quantity of its level at which
+        // nothing is queued ahead of the order anymore
+        double QueuePosition = 0;
+        Order *BookPrev = nullptr;
+        Order *BookNext = nullptr;
+        // Amends accepted by the simulation and not acknowledged yet, fills wait for them
+        u_int32_t PendingReplaces = 0;
+
         std::string ToString() const
         {
             std::ostringstream oss;
@@ -163,6 +179,9 @@ namespace CRPT::Core
 
     typedef MarketDataUpdate *MarketDataUpdatePtr;
 
+    template <class T>
+    concept IsMarketDataUpdate = std::derived_from<T, MarketDataUpdate>;
+
     struct MDTrade : public MarketDataUpdate
     {
         double Price;
@@ -194,6 +213,75 @@ namespace CRPT::Core
 
     using MDTradePtr = MDTrade *;
 
+    // Column-wise storage of trades. The merge only reads EventTimestamps and Simulation
+    // matches from the price, qty, side and instrument columns; an MDTrade, instrument name
+    // included, is built only for the market data callbacks.
+    struct MDTradeColumns
+    {
+        std::vector<UpdateId> Ids;
+        std::vector<Timestamp> EventTimestamps;
+        std::vector<double> Prices;
+        std::vector<double> Qtys;
+        std::vector<Side> AggressorSides;
+        std::vector<u_int32_t> InstrumentIds;
+        std::vector<InstrumentPtr> Instruments;
+
+        MDTradeColumns() = default;
+
+        MDTradeColumns(const std::vector<MDTrade> &trades)
+        {
+            reserve(trades.size());
+            for (auto &trade : trades)
+                push_back(trade);
+        }
+
+        size_t size() const
+        {
+            return EventTimestamps.size();
+        }
+
+        void reserve(size_t n)
+        {
+            Ids.reserve(n);
+            EventTimestamps.reserve(n);
+            Prices.reserve(n);
+            Qtys.reserve(n);
+            AggressorSides.reserve(n);
+            InstrumentIds.reserve(n);
+        }
+
+        // A row rarely holds more than a few instruments, so a linear lookup is enough
+        u_int32_t InternInstrument(const InstrumentPtr &instrument)
+        {
+            for (size_t i = Instruments.size(); i-- > 0;)
+                if (Instruments[i] == instrument)
+                    return i;
+            Instruments.push_back(instrument);
+            return Instruments.size() - 1;
+        }
+
+        void push_back(const MDTrade &trade)
+        {
+            Ids.push_back(trade.Id);
+            EventTimestamps.push_back(trade.EventTimestamp);
+            Prices.push_back(trade.Price);
+            Qtys.push_back(trade.Qty);
+            AggressorSides.push_back(trade.AggressorSide);
+            InstrumentIds.push_back(InternInstrument(trade.Instrument));
+        }
+
+        void Materialize(size_t n, MDTrade &trade) const
+        {
+            trade.Id = Ids[n];
+            trade.EventTimestamp = EventTimestamps[n];
+            trade.LocalTimestamp = EventTimestamps[n];
+            trade.Price = Prices[n];
+            trade.Qty = Qtys[n];
+            trade.AggressorSide = AggressorSides[n];
+            trade.Instrument = Instruments[InstrumentIds[n]];
+        }
+    };
+
     struct MDL1Update : public MarketDataUpdate
     {
         double AskPrice;
@@ -235,10 +323,13 @@ namespace CRPT::Core
         double Qty;
     };
 
+    // Changed depth levels, best first. A level with Qty 0 is removed, a snapshot replaces
+    // the whole book. The levels are views into the storage of the row, see MDL2Updates.
     struct MDL2Update : public MarketDataUpdate
     {
-        std::vector<MDL2Level> Ask;
-        std::vector<MDL2Level> Bid;
+        std::span<const MDL2Level> Ask;
+        std::span<const MDL2Level> Bid;
+        bool Snapshot = false;
         Timestamp LocalTimestamp;
         InstrumentPtr Instrument;
         MDL2Update()
@@ -249,6 +340,69 @@ namespace CRPT::Core
 
     using MDL2UpdatePtr = MDL2Update *;
 
+    // Depth updates of a row with the levels of all updates in two flat arrays, each
+    // update views its slice of them
+    struct MDL2Updates
+    {
+        std::vector<MDL2Update> Updates;
+        std::vector<MDL2Level> AskLevels;
+        std::vector<MDL2Level> BidLevels;
+
+        MDL2Updates() = default;
+        MDL2Updates(MDL2Updates &&) = default;
+        MDL2Updates &operator=(MDL2Updates &&) = default;
+
+        MDL2Updates(const MDL2Updates &other) : Updates(other.Updates),
+                                                AskLevels(other.AskLevels),
+                                                BidLevels(other.BidLevels),
+                                                m_askBegins(other.m_askBegins),
+                                                m_bidBegins(other.m_bidBegins)
+        {
+            rebind();
+        }
+
+        MDL2Updates &operator=(const MDL2Updates &other)
+        {
+            return *this = MDL2Updates(other);
+        }
+
+        size_t size() const
+        {
+            return Updates.size();
+        }
+
+        // Copies update with its levels
+        void push_back(const MDL2Update &update)
+        {
+            const MDL2Level *asks = AskLevels.data(), *bids = BidLevels.data();
+            m_askBegins.push_back(AskLevels.size());
+            m_bidBegins.push_back(BidLevels.size());
+            AskLevels.insert(AskLevels.end(), update.Ask.begin(), update.Ask.end());
+            BidLevels.insert(BidLevels.end(), update.Bid.begin(), update.Bid.end());
+            Updates.push_back(update);
+            if (asks != AskLevels.data() || bids != BidLevels.data())
+                rebind();
+            else
+                rebind(Updates.size() - 1);
+        }
+
+    private:
+        void rebind()
+        {
+            for (size_t i = 0; i < Updates.size(); ++i)
+                rebind(i);
+        }
+
+        void rebind(size_t n)
+        {
+            Updates[n].Ask = std::span<const MDL2Level>(AskLevels.data() + m_askBegins[n], Updates[n].Ask.size());
+            Updates[n].Bid = std::span<const MDL2Level>(BidLevels.data() + m_bidBegins[n], Updates[n].Bid.size());
+        }
+
+        std::vector<size_t> m_askBegins;
+        std::vector<size_t> m_bidBegins;
+    };
+
     struct MDCustomUpdate : public MarketDataUpdate
     {
         std::string Text;
@@ -0,0 +1,288 @@
+#pragma once
+
+#include "entity.hpp"
+#include "../utils/mapped_file.hpp"
+#include "../utils/spsc_ring.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Core
+{
+    enum class JournalEvent : u_int8_t
+    {
+        New = 0,
+        Canceled = 1,
+        Replaced = 2,
+        Filled = 3,
+        PartiallyFilled = 4
+    };
+
+    inline std::string ToString(JournalEvent event)
+    {
+        switch (event)
+        {
+        case JournalEvent::New:
+            return "New";
+        case JournalEvent::Canceled:
+            return "Canceled";
+        case JournalEvent::Replaced:
+            return "Replaced";
+        case JournalEvent::Filled:
+            return "Filled";
+        case JournalEvent::PartiallyFilled:
+            return "PartiallyFilled";
+        }
+        return "UnknownJournalEvent";
+    }
+
+    // Order lifecycle event as written to the journal file
+    struct JournalRecord
+    {
+        Timestamp EventTimestamp;
+        Timestamp CreateTimestamp;
+        OrderId Id;
+        double Price;
+        double Qty;
+        double FilledQty;
+        double LastExecPrice;
+        u_int32_t Instrument;
+        JournalEvent Event;
+        Side OrderSide;
+        u_int8_t Type;
+        u_int8_t State;
+    };
+
+    // Binary journal of order events. Record only copies a fixed-size record into a lock-free
+    // ring, a background thread writes the ring to the file. Records are never dropped: when the
+    // ring is full Record waits for the writer.
+    // File layout: JournalHeader, records, instrument table (u_int32_t length + bytes per name),
+    // then the u_int64_t offset of the table.
+    class Journal
+    {
+    public:
+        static constexpr char MAGIC[8] = {'C', 'R', 'P', 'T', 'J', 'R', 'N', '1'};
+
+        struct JournalHeader
+        {
+            char Magic[8];
+            u_int32_t Version;
+            u_int32_t RecordSize;
+        };
+
+        Journal(const std::string &path, size_t capacity = 1 << 16) : m_path(path),
+                                                                      m_file(path, std::ios::binary),
+                                                                      m_ring(capacity)
+        {
+            if (!m_file)
+                throw std::runtime_error("Unable to open " + path);
+            JournalHeader header{};
+            std::memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+            header.Version = 1;
+            header.RecordSize = sizeof(JournalRecord);
+            m_file.write((const char *)&header, sizeof(header));
+            m_writer = std::thread([this]()
+                                   { write(); });
+        }
+
+        Journal(const Journal &) = delete;
+
+        ~Journal()
+        {
+            try
+            {
+                Close();
+            }
+            catch (const std::runtime_error &)
+            {
+            }
+        }
+
+        // Called from the simulation thread only
+        void Record(JournalEvent event, const Order &order, Timestamp timestamp)
+        {
+            JournalRecord record{timestamp, order.CreateTimestamp, order.Id, order.Price, order.Qty,
+                                 order.FilledQty, order.LastExecPrice, internInstrument(order.Instrument),
+                                 event, order.OrderSide, u_int8_t(order.Type), u_int8_t(order.State)};
+            while (!m_ring.TryPush(record))
+            {
+                ++m_stalls;
+                std::this_thread::yield();
+            }
+        }
+
+        // Number of times Record found the ring full
+        size_t GetStalls() const
+        {
+            return m_stalls;
+        }
+
+        // Flushes the pending records and writes the instrument table, throws if any write
+        // of the journal failed
+        void Close()
+        {
+            if (!m_writer.joinable())
+                return;
+            m_stopped = true;
+            m_writer.join();
+
+            u_int64_t offset = m_file.tellp();
+            for (auto &instrument : m_instruments)
+            {
+                u_int32_t length = instrument.size();
+                m_file.write((const char *)&length, sizeof(length));
+                m_file.write(instrument.data(), length);
+            }
+            m_file.write((const char *)&offset, sizeof(offset));
+            m_file.close();
+            if (m_failed || !m_file)
+                throw std::runtime_error("Unable to write " + m_path);
+        }
+
+    private:
+        // A strategy trades a handful of instruments, so a linear lookup is enough
+        u_int32_t internInstrument(const InstrumentPtr &instrument)
+        {
+            if (m_lastInstrument < m_instruments.size() && m_instruments[m_lastInstrument] == instrument)
+                return m_lastInstrument;
+            for (size_t i = 0; i < m_instruments.size(); ++i)
+                if (m_instruments[i] == instrument)
+                    return m_lastInstrument = i;
+            m_instruments.push_back(instrument);
+            return m_lastInstrument = m_instruments.size() - 1;
+        }
+
+        void write()
+        {
+            std::vector<JournalRecord> batch(4096);
+            while (true)
+            {
+                bool stopped = m_stopped;
+                size_t count = m_ring.PopBatch(batch.data(), batch.size());
+                // After a failure the ring is still drained, so Record never blocks on it
+                if (count > 0 && !m_failed)
+                {
+                    m_file.write((const char *)batch.data(), count * sizeof(JournalRecord));
+                    m_failed = !m_file;
+                }
+                else if (count == 0 && stopped)
+                    return;
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+
+        std::string m_path;
+        std::ofstream m_file;
+        Utils::SPSCRing<JournalRecord> m_ring;
+        std::thread m_writer;
+        std::atomic<bool> m_stopped{false};
+        // Set by the writer thread, read by Close once it has joined
+        bool m_failed{false};
+        size_t m_stalls{0};
+        std::vector<InstrumentPtr> m_instruments;
+        u_int32_t m_lastInstrument{0};
+    };
+
+    // Reads a closed journal and converts it for analysis
+    class JournalReader
+    {
+    public:
+        JournalReader(const std::string &path) : m_file(path)
+        {
+            Journal::JournalHeader header;
+            u_int64_t tableOffset;
+            if (m_file.size() < sizeof(header) + sizeof(tableOffset))
+                throw std::runtime_error(path + " is not a closed journal");
+            std::memcpy(&header, m_file.data(), sizeof(header));
+            std::memcpy(&tableOffset, m_file.data() + m_file.size() - sizeof(tableOffset), sizeof(tableOffset));
+            if (std::memcmp(header.Magic, Journal::MAGIC, sizeof(header.Magic)) != 0 || header.RecordSize != sizeof(JournalRecord) ||
+                tableOffset < sizeof(header) || tableOffset > m_file.size() - sizeof(tableOffset) ||
+                (tableOffset - sizeof(header)) % sizeof(JournalRecord) != 0)
+                throw std::runtime_error(path + " is not a closed journal");
+
+            m_records = std::span<const JournalRecord>((const JournalRecord *)(m_file.data() + sizeof(header)),
+                                                       (tableOffset - sizeof(header)) / sizeof(JournalRecord));
+            const char *cursor = m_file.data() + tableOffset;
+            const char *end = m_file.data() + m_file.size() - sizeof(tableOffset);
+            while (cursor + sizeof(u_int32_t) <= end)
+            {
+                u_int32_t length;
+                std::memcpy(&length, cursor, sizeof(length));
+                cursor += sizeof(length);
+                if (cursor + length > end)
+                    throw std::runtime_error(path + " is truncated");
+                m_instruments.emplace_back(cursor, length);
+                cursor += length;
+            }
+        }
+
+        std::span<const JournalRecord> Records() const
+        {
+            return m_records;
+        }
+
+        const std::vector<std::string> &GetInstruments() const
+        {
+            return m_instruments;
+        }
+
+        void ToCSV(const std::string &path, char sep = ',') const
+        {
+            std::ofstream file{path};
+            if (!file)
+                throw std::runtime_error("Unable to open " + path);
+            file << "event_timestamp" << sep << "event" << sep << "order_id" << sep << "instrument" << sep
+                 << "side" << sep << "type" << sep << "state" << sep << "price" << sep << "qty" << sep
+                 << "filled_qty" << sep << "last_exec_price" << sep << "create_timestamp" << '\n';
+            file.precision(17);
+            for (auto &record : m_records)
+                file << record.EventTimestamp << sep << ToString(record.Event) << sep << record.Id << sep
+                     << m_instruments.at(record.Instrument) << sep << ToString(record.OrderSide) << sep
+                     << ToString(OrderType(record.Type)) << sep << ToString(OrderState(record.State)) << sep
+                     << record.Price << sep << record.Qty << sep << record.FilledQty << sep
+                     << record.LastExecPrice << sep << record.CreateTimestamp << '\n';
+            if (!file)
+                throw std::runtime_error("Unable to write " + path);
+        }
+
+        // One raw little-endian array file per field, <field>.bin, plus instruments.txt
+        // with the names of the instrument ids, one per line
+        void ToColumns(const std::string &directory) const
+        {
+            std::filesystem::create_directories(directory);
+            writeColumn(directory, "event_timestamp", &JournalRecord::EventTimestamp);
+            writeColumn(directory, "create_timestamp", &JournalRecord::CreateTimestamp);
+            writeColumn(directory, "order_id", &JournalRecord::Id);
+            writeColumn(directory, "price", &JournalRecord::Price);
+            writeColumn(directory, "qty", &JournalRecord::Qty);
+            writeColumn(directory, "filled_qty", &JournalRecord::FilledQty);
+            writeColumn(directory, "last_exec_price", &JournalRecord::LastExecPrice);
+            writeColumn(directory, "instrument", &JournalRecord::Instrument);
+            writeColumn(directory, "event", &JournalRecord::Event);
+            writeColumn(directory, "side", &JournalRecord::OrderSide);
+            writeColumn(directory, "type", &JournalRecord::Type);
+            writeColumn(directory, "state", &JournalRecord::State);
+
+            std::ofstream file{std::filesystem::path(directory) / "instruments.txt"};
+            for (auto &instrument : m_instruments)
+                file << instrument << '\n';
+        }
+
+    private:
+        template <class F>
+        void writeColumn(const std::string &directory, const std::string &name, F JournalRecord::*field) const
+        {
+            std::vector<F> column;
+            column.reserve(m_records.size());
+            for (auto &record : m_records)
+                column.push_back(record.*field);
+            std::ofstream file{std::filesystem::path(directory) / (name + ".bin"), std::ios::binary};
+            file.write((const char *)column.data(), column.size() * sizeof(F));
+            if (!file)
+                throw std::runtime_error("Unable to write column " + name);
+        }
+
+        Utils::MappedFile m_file;
+        std::span<const JournalRecord> m_records;
+        std::vector<std::string> m_instruments;
+    };
+}
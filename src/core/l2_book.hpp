@@ -0,0 +1,117 @@
+#pragma once
+
+#include "entity.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Core
+{
+    // Displayed depth of one instrument, maintained from MDL2Updates. Each side keeps its
+    // prices and quantities in two flat arrays, worst level first and the best level last,
+    // so changes near the top of the book insert and erase at the end of the arrays and move
+    // few elements.
+    class L2Book
+    {
+    public:
+        void Apply(const MDL2Update &update)
+        {
+            if (update.Snapshot)
+                Clear();
+            apply(m_bid, update.Bid, update.Snapshot, std::less<double>());
+            apply(m_ask, update.Ask, update.Snapshot, std::greater<double>());
+        }
+
+        void Clear()
+        {
+            m_bid.Prices.clear();
+            m_bid.Qtys.clear();
+            m_ask.Prices.clear();
+            m_ask.Qtys.clear();
+        }
+
+        // Levels of each side, worst first and best last
+        std::span<const double> BidPrices() const
+        {
+            return m_bid.Prices;
+        }
+
+        std::span<const double> BidQtys() const
+        {
+            return m_bid.Qtys;
+        }
+
+        std::span<const double> AskPrices() const
+        {
+            return m_ask.Prices;
+        }
+
+        std::span<const double> AskQtys() const
+        {
+            return m_ask.Qtys;
+        }
+
+        std::optional<double> GetBestBid() const
+        {
+            if (m_bid.Prices.empty())
+                return std::nullopt;
+            return m_bid.Prices.back();
+        }
+
+        std::optional<double> GetBestAsk() const
+        {
+            if (m_ask.Prices.empty())
+                return std::nullopt;
+            return m_ask.Prices.back();
+        }
+
+        // Displayed quantity at price, 0 if the level is not in the book
+        double GetQty(Side side, double price) const
+        {
+            auto &bookSide = side == Side::Buy ? m_bid : m_ask;
+            auto position = side == Side::Buy
+                                ? std::lower_bound(bookSide.Prices.begin(), bookSide.Prices.end(), price)
+                                : std::lower_bound(bookSide.Prices.begin(), bookSide.Prices.end(), price, std::greater<double>());
+            if (position == bookSide.Prices.end() || *position != price)
+                return 0;
+            return bookSide.Qtys[position - bookSide.Prices.begin()];
+        }
+
+    private:
+        struct BookSide
+        {
+            std::vector<double> Prices;
+            std::vector<double> Qtys;
+        };
+
+        template <class Worse>
+        static void apply(BookSide &side, std::span<const MDL2Level> levels, bool snapshot, Worse worse)
+        {
+            // Snapshots arrive best first, walking them backwards appends every level
+            for (size_t i = 0; i < levels.size(); ++i)
+            {
+                auto &level = snapshot ? levels[levels.size() - 1 - i] : levels[i];
+                size_t n = side.Prices.empty() || worse(side.Prices.back(), level.Price)
+                               ? side.Prices.size()
+                               : std::lower_bound(side.Prices.begin(), side.Prices.end(), level.Price, worse) - side.Prices.begin();
+                bool exists = n < side.Prices.size() && side.Prices[n] == level.Price;
+                if (level.Qty > 0)
+                {
+                    if (exists)
+                        side.Qtys[n] = level.Qty;
+                    else
+                    {
+                        side.Prices.insert(side.Prices.begin() + n, level.Price);
+                        side.Qtys.insert(side.Qtys.begin() + n, level.Qty);
+                    }
+                }
+                else if (exists)
+                {
+                    side.Prices.erase(side.Prices.begin() + n);
+                    side.Qtys.erase(side.Qtys.begin() + n);
+                }
+            }
+        }
+
+        BookSide m_bid;
+        BookSide m_ask;
+    };
+}
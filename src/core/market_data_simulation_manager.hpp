@@ -1,7 +1,13 @@
 #pragma once
 
+#include "compressed_tick_store.hpp"
+#include "csv_cache.hpp"
 #include "entity.hpp"
+#include "market_data_source.hpp"
+#include "tick_store.hpp"
+#include "../utils/csv_reader.hpp"
 #include "../utils/helpers.hpp"
+#include "../utils/market_data_sorter.hpp"
 #include "../definitions.h"
 
 namespace CRPT::Core
@@ -46,6 +52,18 @@ namespace CRPT::Core
         {
         }
 
+        MDRow(const std::vector<MDL2Update> &row, const std::string &rowName = "") : 
+                                                                                     m_row{BufferPtr(row.data())},
+                                                                                     m_typeSize(sizeof(MDL2Update)),
+                                                                                     m_rowSize(row.size()),
+                                                                                     m_rowName(rowName)
+        {
+        }
+
+        MDRow(const MDL2Updates &row, const std::string &rowName = "") : MDRow(row.Updates, rowName)
+        {
+        }
+
         MDRow(const std::vector<MDCustomUpdate> &row, const std::string &rowName = "") : 
                                                                                          m_row{BufferPtr(row.data())},
                                                                                          m_typeSize(sizeof(MDCustomUpdate)),
@@ -62,23 +80,189 @@ namespace CRPT::Core
         {
         }
 
+        // Streaming row: elements are pulled from the source chunk by chunk, at most two
+        // chunks are held at a time. The row must be read forward and chunkSize must exceed
+        // the number of updates in flight inside the simulation (its QueueSize).
+        template <IsMarketDataUpdate T>
+        MDRow(MDRowSourcePtr<T> source, size_t chunkSize, const std::string &rowName = "") : 
+                                                                                           m_row{nullptr},
+                                                                                           m_typeSize(sizeof(T)),
+                                                                                           m_rowSize(0),
+                                                                                           m_stream(std::make_shared<ChunkedMDRowStream<T>>(source, chunkSize)),
+                                                                                           m_rowName(rowName)
+        {
+        }
+
+        // Row over a memory-mapped tick file, see TickStore
+        MDRow(TickStore::MappedTickFilePtr file, size_t chunkSize = DEFAULT_CHUNK_SIZE, const std::string &rowName = "") : 
+                                                                                                                         MDRow(makeTickSource(file, chunkSize, rowName))
+        {
+        }
+
+        MDRow(CompressedTickStore::CompressedTickFilePtr file, size_t chunkSize = DEFAULT_CHUNK_SIZE, const std::string &rowName = "") : 
+                                                                                                                                      MDRow(makeTickSource(file, chunkSize, rowName))
+        {
+        }
+
+        // Row over a plain or compressed tick file
+        MDRow(const std::string &tickFilePath, size_t chunkSize = DEFAULT_CHUNK_SIZE, const std::string &rowName = "") : 
+                                                                                                                        MDRow(CompressedTickStore::IsCompressedTickFile(tickFilePath)
+                                                                                                                                  ? makeTickSource(std::make_shared<CompressedTickStore::CompressedTickFile>(tickFilePath), chunkSize, rowName)
+                                                                                                                                  : makeTickSource(std::make_shared<TickStore::MappedTickFile>(tickFilePath), chunkSize, rowName))
+        {
+        }
+
+        // Columnar trades row, the row shares ownership of the columns. The merge, Seek and
+        // Simulation read the columns directly; operator[] materializes the trade into a buffer
+        // of the row, valid until the next call.
+        MDRow(std::shared_ptr<const MDTradeColumns> columns, const std::string &rowName = "") : 
+                                                                                               m_row{nullptr},
+                                                                                               m_typeSize(sizeof(MDTrade)),
+                                                                                               m_rowSize(columns->size()),
+                                                                                               m_columns(columns),
+                                                                                               m_trade(std::make_shared<MDTrade>()),
+                                                                                               m_rowName(rowName)
+        {
+        }
+
         MarketDataUpdatePtr operator[](size_t n) const
         {
-            if (n < m_rowSize)
-                return (MarketDataUpdatePtr)&m_row[m_typeSize * n];
-            else
+            if (m_stream)
+                return m_stream->At(n);
+            if (n >= m_rowSize)
                 return nullptr;
+            if (m_columns)
+            {
+                m_columns->Materialize(n, *m_trade);
+                return m_trade.get();
+            }
+            return (MarketDataUpdatePtr)&m_row[m_typeSize * n];
+        }
+
+        // Reads the timestamp of element n without materializing it when the row is
+        // columnar; returns false past the end of the row
+        bool PeekTimestamp(size_t n, Timestamp &timestamp) const
+        {
+            if (m_columns)
+            {
+                if (n >= m_rowSize)
+                    return false;
+                timestamp = m_columns->EventTimestamps[n];
+                return true;
+            }
+            MarketDataUpdatePtr update = operator[](n);
+            if (update == nullptr)
+                return false;
+            timestamp = update->EventTimestamp;
+            return true;
+        }
+
+        // Index of the first element with EventTimestamp >= timestamp. Materialized and columnar
+        // rows are binary searched. Streaming rows skip ahead when their source can seek, tick
+        // files can, and are read forward from there.
+        size_t Seek(Timestamp timestamp) const
+        {
+            size_t first = 0;
+            Timestamp current = 0;
+            if (m_stream)
+            {
+                first = m_stream->Seek(timestamp).value_or(0);
+                while (PeekTimestamp(first, current) && current < timestamp)
+                    ++first;
+                return first;
+            }
+
+            size_t count = m_rowSize;
+            while (count > 0)
+            {
+                size_t step = count / 2;
+                PeekTimestamp(first + step, current);
+                if (current < timestamp)
+                {
+                    first += step + 1;
+                    count -= step + 1;
+                }
+                else
+                    count = step;
+            }
+            return first;
+        }
+
+        // Hints the CPU to load element n and its timestamp; doesn't materialize anything
+        void Prefetch(size_t n) const
+        {
+            if (m_columns)
+            {
+                if (n < m_rowSize)
+                    __builtin_prefetch(&m_columns->EventTimestamps[n]);
+            }
+            else if (m_stream)
+            {
+                if (const void *address = m_stream->Address(n))
+                    __builtin_prefetch(address);
+            }
+            else if (n < m_rowSize)
+                __builtin_prefetch(&m_row[m_typeSize * n]);
+        }
+
+        // For streaming rows, the number of elements pulled so far
+        size_t size() const
+        {
+            return m_stream ? m_stream->Pulled() : m_rowSize;
+        }
+
+        bool IsStreaming() const
+        {
+            return m_stream != nullptr;
+        }
+
+        // Columns of a columnar row, nullptr for other rows
+        const MDTradeColumns *Columns() const
+        {
+            return m_columns.get();
         }
 
-        size_t size()
+        void Rewind()
         {
-            return m_rowSize;
+            if (m_stream)
+                m_stream->Rewind();
         }
 
+        static constexpr size_t DEFAULT_CHUNK_SIZE = 1 << 16;
+
     private:
+        static MDRow makeTickSource(TickStore::MappedTickFilePtr file, size_t chunkSize, const std::string &rowName)
+        {
+            switch (file->GetDataType())
+            {
+            case MarketDataType::Trade:
+                return MDRow(MDRowSourcePtr<MDTrade>(std::make_shared<TickStore::MappedTickSource<MDTrade>>(file)), chunkSize, rowName);
+            case MarketDataType::L1Update:
+                return MDRow(MDRowSourcePtr<MDL1Update>(std::make_shared<TickStore::MappedTickSource<MDL1Update>>(file)), chunkSize, rowName);
+            default:
+                throw std::runtime_error("Data type is not supported");
+            }
+        }
+
+        static MDRow makeTickSource(CompressedTickStore::CompressedTickFilePtr file, size_t chunkSize, const std::string &rowName)
+        {
+            switch (file->GetDataType())
+            {
+            case MarketDataType::Trade:
+                return MDRow(MDRowSourcePtr<MDTrade>(std::make_shared<CompressedTickStore::CompressedTickSource<MDTrade>>(file)), chunkSize, rowName);
+            case MarketDataType::L1Update:
+                return MDRow(MDRowSourcePtr<MDL1Update>(std::make_shared<CompressedTickStore::CompressedTickSource<MDL1Update>>(file)), chunkSize, rowName);
+            default:
+                throw std::runtime_error("Data type is not supported");
+            }
+        }
+
         BufferPtr m_row;
         size_t m_typeSize;
         size_t m_rowSize;
+        std::shared_ptr<MDRowStream> m_stream;
+        std::shared_ptr<const MDTradeColumns> m_columns;
+        std::shared_ptr<MDTrade> m_trade;
         std::string m_rowName;
     };
 
@@ -89,16 +273,37 @@ namespace CRPT::Core
         class iterator
         {
         public:
-            iterator(MarketDataSimulationManager &obj) : m_counters(obj.m_buffers.size(), 0),
-                                                         m_obj(obj)
+            iterator(MarketDataSimulationManager &obj) : m_obj(obj)
             {
+                if (!m_obj.m_order.empty())
+                {
+                    m_replay = true;
+                    m_position = m_obj.seekOrder(m_obj.m_windowStart);
+                    m_replayEnd = m_obj.seekOrder(m_obj.m_windowEnd);
+                    this->operator++();
+                    return;
+                }
+
+                m_counters.assign(m_obj.m_buffers.size(), 0);
+                m_heap.reserve(m_counters.size());
+                for (size_t i = 0; i < m_counters.size(); ++i)
+                {
+                    Timestamp head;
+                    if (m_obj.m_windowStart != 0)
+                        m_counters[i] = m_obj.m_buffers[i].Seek(m_obj.m_windowStart);
+                    if (m_obj.m_buffers[i].PeekTimestamp(m_counters[i], head) && head < m_obj.m_windowEnd)
+                        m_heap.push_back({head, i});
+                }
+                for (size_t i = m_heap.size() / 2; i-- > 0;)
+                    siftDown(i);
                 this->operator++();
             }
 
             bool operator==(const iterator &other)
             {
-                return m_currentElement == other.m_currentElement;
-                //|| (m_currentElement == nullptr && other.m_currentElement == nullptr);
+                if (m_end || other.m_end)
+                    return m_end == other.m_end;
+                return m_currentRow == other.m_currentRow && m_currentIndex == other.m_currentIndex;
             }
 
             bool operator!=(const iterator &other)
@@ -106,89 +311,187 @@ namespace CRPT::Core
                 return !(*this == other);
             }
 
+            // Elements of columnar rows are materialized here, on first access, and stay valid
+            // until the row is accessed again
             const MarketDataUpdatePtr &operator*()
             {
+                if (m_currentElement == nullptr && !m_end)
+                    m_currentElement = m_obj.m_buffers[m_currentRow][m_currentIndex];
                 return m_currentElement;
             }
 
             MarketDataUpdatePtr operator->()
             {
-                return m_currentElement;
+                return operator*();
             }
 
-            iterator operator+(size_t steps)
+            Timestamp CurrentTimestamp() const
+            {
+                return m_currentTimestamp;
+            }
+
+            // Columns of the current element when its row is columnar, nullptr otherwise; the
+            // element is CurrentIndex() of the columns
+            const MDTradeColumns *CurrentColumns() const
             {
-                ++steps;
-                auto counters(m_counters);
-                auto currentElement(m_currentElement);
-                for (; steps > 0; --steps)
+                return m_end ? nullptr : m_obj.m_buffers[m_currentRow].Columns();
+            }
+
+            size_t CurrentIndex() const
+            {
+                return m_currentIndex;
+            }
+
+            bool HasNext() const
+            {
+                if (m_replay)
+                    return m_position < m_replayEnd;
+                return !m_heap.empty();
+            }
+
+            // Timestamp of the element the next increment will yield, read off the heap top
+            Timestamp PeekNextTimestamp() const
+            {
+                if (m_replay)
                 {
-                    int argmin = -1;
-                    Timestamp min = std::numeric_limits<Timestamp>::max();
-                    for (size_t i = 0; i < counters.size(); ++i)
-                    {
-                        if (counters[i] < m_obj.m_buffers[i].size())
-                        {
-                            MarketDataUpdatePtr update = m_obj.m_buffers[i][counters[i]];
-                            if (update->EventTimestamp <= min)
-                            {
-                                min = update->EventTimestamp;
-                                argmin = i;
-                            }
-                        }
-                    }
-                    if (argmin == -1)
-                    {
-                        currentElement = nullptr;
-                    }
-                    else
-                    {
-                        currentElement = m_obj.m_buffers[argmin][counters[argmin]]; // dangerous
-                        ++counters[argmin];
-                    }
+                    if (m_position >= m_replayEnd)
+                        return std::numeric_limits<Timestamp>::max();
+                    auto &step = m_obj.m_order[m_position];
+                    Timestamp timestamp = 0;
+                    m_obj.m_buffers[step.Row].PeekTimestamp(step.Index, timestamp);
+                    return timestamp;
                 }
-                iterator result(m_obj);
-                result.m_counters = counters;
-                result.m_currentElement = currentElement;
+                return m_heap.empty() ? std::numeric_limits<Timestamp>::max() : m_heap[0].EventTimestamp;
+            }
+
+            iterator operator+(size_t steps)
+            {
+                iterator result(*this);
+                for (++steps; steps > 0; --steps)
+                    ++result;
                 return result;
             }
 
             iterator &operator++()
             {
-                int argmin = -1;
-                Timestamp min = std::numeric_limits<Timestamp>::max();
-                for (size_t i = 0; i < m_counters.size(); ++i)
+                if (m_replay)
                 {
-                    if (m_counters[i] < m_obj.m_buffers[i].size())
+                    if (m_position >= m_replayEnd)
+                    {
+                        m_end = true;
+                        m_currentElement = nullptr;
+                        return *this;
+                    }
+                    if (m_obj.m_prefetchDistance != 0 && m_position + m_obj.m_prefetchDistance < m_replayEnd)
                     {
-                        MarketDataUpdatePtr update = m_obj.m_buffers[i][m_counters[i]];
-                        if (update->EventTimestamp <= min)
-                        {
-                            min = update->EventTimestamp;
-                            argmin = i;
-                        }
+                        auto &ahead = m_obj.m_order[m_position + m_obj.m_prefetchDistance];
+                        m_obj.m_buffers[ahead.Row].Prefetch(ahead.Index);
                     }
+                    auto &step = m_obj.m_order[m_position++];
+                    setCurrent(step.Row, step.Index);
+                    m_obj.m_buffers[step.Row].PeekTimestamp(step.Index, m_currentTimestamp);
+                    return *this;
                 }
 
-                if (argmin == -1)
+                if (m_heap.empty())
                 {
+                    m_end = true;
                     m_currentElement = nullptr;
+                    return *this;
                 }
-                else
+
+                size_t row = m_heap[0].Row;
+                setCurrent(row, m_counters[row]);
+                m_currentTimestamp = m_heap[0].EventTimestamp;
+                if (!m_obj.m_buffers[row].PeekTimestamp(++m_counters[row], m_heap[0].EventTimestamp) ||
+                    m_heap[0].EventTimestamp >= m_obj.m_windowEnd)
                 {
-                    m_currentElement = m_obj.m_buffers[argmin][m_counters[argmin]]; // dangerous
-                    ++m_counters[argmin];
+                    m_heap[0] = m_heap.back();
+                    m_heap.pop_back();
                 }
+                siftDown(0);
+                if (m_obj.m_prefetchDistance != 0)
+                    prefetch(row);
                 return *this;
             };
 
         private:
+            struct EndTag
+            {
+            };
+
+            iterator(MarketDataSimulationManager &obj, EndTag) : m_end(true), m_obj(obj)
+            {
+            }
+
+            // Elements of columnar rows are left to operator*, Simulation reads their columns
+            void setCurrent(size_t row, size_t index)
+            {
+                m_currentRow = row;
+                m_currentIndex = index;
+                m_currentElement = m_obj.m_buffers[row].Columns() ? nullptr : m_obj.m_buffers[row][index];
+            }
+
+            // Head of a row inside the merge heap. On equal timestamps the row
+            // with the greater index goes first, as the linear scan used to do.
+            struct HeapEntry
+            {
+                Timestamp EventTimestamp;
+                size_t Row;
+
+                bool operator<(const HeapEntry &other) const
+                {
+                    return EventTimestamp < other.EventTimestamp ||
+                           (EventTimestamp == other.EventTimestamp && Row > other.Row);
+                }
+            };
+
+            // Loads ahead the row that has just advanced and the heads of the rows
+            // closest to winning, which sit at the top of the heap
+            void prefetch(size_t advancedRow)
+            {
+                m_obj.m_buffers[advancedRow].Prefetch(m_counters[advancedRow] + m_obj.m_prefetchDistance);
+                for (size_t i = 0; i < std::min<size_t>(m_heap.size(), 3); ++i)
+                    m_obj.m_buffers[m_heap[i].Row].Prefetch(m_counters[m_heap[i].Row]);
+            }
+
+            void siftDown(size_t pos)
+            {
+                size_t size = m_heap.size();
+                if (pos >= size)
+                    return;
+                HeapEntry entry = m_heap[pos];
+                for (size_t child = 2 * pos + 1; child < size; child = 2 * pos + 1)
+                {
+                    if (child + 1 < size && m_heap[child + 1] < m_heap[child])
+                        ++child;
+                    if (!(m_heap[child] < entry))
+                        break;
+                    m_heap[pos] = m_heap[child];
+                    pos = child;
+                }
+                m_heap[pos] = entry;
+            }
+
             friend MarketDataSimulationManager;
             std::vector<u_int64_t> m_counters;
+            std::vector<HeapEntry> m_heap;
+            bool m_replay{false};
+            u_int64_t m_position{0}, m_replayEnd{0};
+            size_t m_currentRow{0}, m_currentIndex{0};
+            Timestamp m_currentTimestamp{0};
+            bool m_end{false};
             MarketDataUpdatePtr m_currentElement{nullptr};
             MarketDataSimulationManager &m_obj;
         };
 
+        // One element of a compiled merge order: the row and the index inside the row
+        struct MergeStep
+        {
+            u_int32_t Row;
+            u_int32_t Index;
+        };
+
         MarketDataSimulationManager() = default;
         MarketDataSimulationManager(std::vector<MDRow> buffers) : m_buffers{buffers}
         {
@@ -196,29 +499,307 @@ namespace CRPT::Core
 
         iterator begin()
         {
+            for (auto &row : m_buffers)
+                row.Rewind();
             return iterator(*this);
         }
 
         iterator end()
         {
-            iterator iter(*this);
-            iter.m_currentElement = nullptr;
-
-            return iter;
+            return iterator(*this, iterator::EndTag{});
         }
 
         void AddRow(const MDRow &row)
         {
             m_buffers.push_back(row);
+            m_order.clear();
         }
 
         void Clear()
         {
             m_buffers.clear();
+            m_order.clear();
+        }
+
+        // Restricts iteration to events with start <= EventTimestamp < end.
+        // Rows are positioned by binary search, nothing is copied.
+        void SetWindow(Timestamp start, Timestamp end = std::numeric_limits<Timestamp>::max())
+        {
+            m_windowStart = start;
+            m_windowEnd = end;
+        }
+
+        void ResetWindow()
+        {
+            SetWindow(0);
+        }
+
+        // Number of elements the iterator loads ahead of the one it emits, 0 turns prefetching off
+        void SetPrefetchDistance(size_t distance)
+        {
+            m_prefetchDistance = distance;
+        }
+
+        // Merges the rows once and keeps the resulting order; subsequent iterations
+        // replay it sequentially instead of merging
+        void CompileOrder()
+        {
+            m_order.clear();
+            std::pair<Timestamp, Timestamp> window{m_windowStart, m_windowEnd};
+            ResetWindow();
+            size_t total = 0;
+            for (auto &row : m_buffers)
+            {
+                if (row.IsStreaming())
+                    throw std::runtime_error("Merge order can't be compiled for streaming rows");
+                if (row.size() > std::numeric_limits<u_int32_t>::max())
+                    throw std::runtime_error("Row is too large to compile the merge order");
+                total += row.size();
+            }
+            if (m_buffers.size() > std::numeric_limits<u_int32_t>::max())
+                throw std::runtime_error("Too many rows to compile the merge order");
+
+            std::vector<MergeStep> order;
+            order.reserve(total);
+            for (auto iter = begin(); iter != end(); ++iter)
+                order.push_back({u_int32_t(iter.m_currentRow), u_int32_t(iter.m_currentIndex)});
+            m_order = std::move(order);
+            SetWindow(window.first, window.second);
+        }
+
+        bool HasCompiledOrder() const
+        {
+            return !m_order.empty();
+        }
+
+        const std::vector<MergeStep> &GetCompiledOrder() const
+        {
+            return m_order;
+        }
+
+        void SaveOrder(const std::string &path) const
+        {
+            if (m_order.empty())
+                throw std::runtime_error("Merge order is not compiled");
+
+            std::ofstream file{path, std::ios::binary};
+            if (!file)
+                throw std::runtime_error("Unable to open " + path);
+            file.write(ORDER_FILE_MAGIC, sizeof(ORDER_FILE_MAGIC));
+            auto fingerprint = getFingerprint();
+            u_int64_t rows = m_buffers.size(), steps = m_order.size();
+            file.write((const char *)&rows, sizeof(rows));
+            file.write((const char *)fingerprint.data(), fingerprint.size() * sizeof(u_int64_t));
+            file.write((const char *)&steps, sizeof(steps));
+            file.write((const char *)m_order.data(), steps * sizeof(MergeStep));
+            if (!file)
+                throw std::runtime_error("Unable to write " + path);
+        }
+
+        // Loads an order saved by SaveOrder; the rows must be the same as at compile time
+        void LoadOrder(const std::string &path)
+        {
+            for (auto &row : m_buffers)
+                if (row.IsStreaming())
+                    throw std::runtime_error("Merge order can't be replayed over streaming rows");
+
+            std::ifstream file{path, std::ios::binary};
+            if (!file)
+                throw std::runtime_error("Unable to open " + path);
+
+            char magic[sizeof(ORDER_FILE_MAGIC)];
+            u_int64_t rows = 0, steps = 0;
+            file.read(magic, sizeof(magic));
+            file.read((char *)&rows, sizeof(rows));
+            if (!file || std::memcmp(magic, ORDER_FILE_MAGIC, sizeof(magic)) != 0)
+                throw std::runtime_error(path + " is not a merge order file");
+            if (rows != m_buffers.size())
+                throw std::runtime_error("Merge order in " + path + " doesn't match the rows");
+
+            auto expected = getFingerprint();
+            std::vector<u_int64_t> fingerprint(expected.size());
+            file.read((char *)fingerprint.data(), fingerprint.size() * sizeof(u_int64_t));
+            file.read((char *)&steps, sizeof(steps));
+            if (!file || fingerprint != expected)
+                throw std::runtime_error("Merge order in " + path + " doesn't match the rows");
+
+            u_int64_t total = 0;
+            for (auto &row : m_buffers)
+                total += row.size();
+            if (steps != total)
+                throw std::runtime_error("Merge order in " + path + " doesn't match the rows");
+
+            std::vector<MergeStep> order(steps);
+            file.read((char *)order.data(), steps * sizeof(MergeStep));
+            if (!file)
+                throw std::runtime_error("Merge order in " + path + " is truncated");
+
+            // Every row must be walked in full and in its own order
+            std::vector<size_t> next(m_buffers.size(), 0);
+            for (auto &step : order)
+            {
+                if (step.Row >= m_buffers.size() || step.Index != next[step.Row])
+                    throw std::runtime_error("Merge order in " + path + " is corrupted");
+                ++next[step.Row];
+            }
+            m_order = std::move(order);
         }
 
     private:
+        // First position of the compiled order with EventTimestamp >= timestamp
+        size_t seekOrder(Timestamp timestamp) const
+        {
+            if (timestamp == 0)
+                return 0;
+            if (timestamp == std::numeric_limits<Timestamp>::max())
+                return m_order.size();
+            auto it = std::partition_point(m_order.begin(), m_order.end(), [&](const MergeStep &step)
+                                           {
+                                               Timestamp current = 0;
+                                               m_buffers[step.Row].PeekTimestamp(step.Index, current);
+                                               return current < timestamp; });
+            return it - m_order.begin();
+        }
+
+        static constexpr char ORDER_FILE_MAGIC[8] = {'C', 'R', 'P', 'T', 'M', 'O', 'R', '1'};
+
+        // Size and boundary timestamps of every row
+        std::vector<u_int64_t> getFingerprint() const
+        {
+            std::vector<u_int64_t> result;
+            result.reserve(m_buffers.size() * 3);
+            for (auto &row : m_buffers)
+            {
+                result.push_back(row.size());
+                result.push_back(row.size() ? row[0]->EventTimestamp : 0);
+                result.push_back(row.size() ? row[row.size() - 1]->EventTimestamp : 0);
+            }
+            return result;
+        }
+
         std::vector<MDRow> m_buffers;
+        std::vector<MergeStep> m_order;
+        Timestamp m_windowStart{0}, m_windowEnd{std::numeric_limits<Timestamp>::max()};
+        size_t m_prefetchDistance{0};
+    };
+
+    // Files are split into chunks of at least CSV_MIN_CHUNK_BYTES parsed on up to threads
+    // threads (0 for all cores); the result doesn't depend on the thread count
+    constexpr size_t CSV_MIN_CHUNK_BYTES = 1 << 20;
+
+    // Appends the updates of the files to out, skipping skipLines lines at the top of
+    // each file, and sorts out. With a cacheKey identifying the schema, files are read
+    // from their CSVCache sidecar when it is fresh and the sidecar is written otherwise.
+    template <IsMarketDataUpdate T>
+    void LoadCSVMarketData(const std::vector<std::string> &paths, const CSVSchema<T> &schema, std::vector<T> &out,
+                           size_t threads = 0, size_t skipLines = 0, const std::string &cacheKey = "")
+    {
+        constexpr bool cacheable = requires { typename TickStore::Traits<T>::Record; };
+        if (!cacheKey.empty() && !cacheable)
+            throw std::runtime_error("Updates of type " + ToString(T().Type) + " can't be cached");
+        if (threads == 0)
+            threads = DefaultThreadCount();
+
+        std::vector<std::string> cachePaths(paths.size());
+        std::vector<std::vector<T>> fileData(paths.size());
+        std::vector<size_t> csvFiles;
+        for (size_t file = 0; file < paths.size(); ++file)
+        {
+            if constexpr (cacheable)
+            {
+                if (!cacheKey.empty())
+                {
+                    cachePaths[file] = CSVCache::Path(paths[file], cacheKey + ":" + std::to_string(skipLines));
+                    if (CSVCache::Load(cachePaths[file], fileData[file]))
+                        continue;
+                }
+            }
+            csvFiles.push_back(file);
+        }
+
+        std::vector<CSVReader> files;
+        size_t totalBytes = 0;
+        for (size_t file : csvFiles)
+        {
+            files.push_back(CSVReader(paths[file]).SkipLines(skipLines));
+            totalBytes += files.back().View().size();
+        }
+
+        // A few chunks per thread even out the uneven line lengths
+        size_t chunkBytes = std::max(CSV_MIN_CHUNK_BYTES, totalBytes / (threads * 4) + 1);
+        std::vector<CSVReader> chunks;
+        std::vector<size_t> chunkFiles;
+        for (size_t i = 0; i < files.size(); ++i)
+            for (auto &chunk : files[i].Split(files[i].View().size() / chunkBytes + 1))
+            {
+                chunks.push_back(std::move(chunk));
+                chunkFiles.push_back(csvFiles[i]);
+            }
+
+        std::vector<std::vector<T>> parsed(chunks.size());
+        ParallelFor(threads, chunks.size(), [&](size_t i)
+                    { chunks[i].Read(schema, parsed[i]); });
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            auto &data = fileData[chunkFiles[i]];
+            if (data.empty())
+                data.swap(parsed[i]);
+            else
+                std::move(parsed[i].begin(), parsed[i].end(), std::back_inserter(data));
+            std::vector<T>().swap(parsed[i]);
+        }
+
+        if constexpr (cacheable)
+        {
+            if (!cacheKey.empty())
+                for (size_t file : csvFiles)
+                    CSVCache::Store(paths[file], cachePaths[file], fileData[file]);
+        }
+
+        // Files are concatenated in order, so each sorted file stays one run
+        size_t total = 0;
+        for (auto &data : fileData)
+            total += data.size();
+        out.reserve(out.size() + total);
+        for (auto &data : fileData)
+        {
+            std::move(data.begin(), data.end(), std::back_inserter(out));
+            std::vector<T>().swap(data);
+        }
+        MarketDataSorter::Sort(out, threads);
+    }
+
+    template <IsMarketDataUpdate T>
+    class CSVMarketDataManager
+    {
+    public:
+        CSVMarketDataManager(const std::vector<std::string> &paths, const CSVSchema<T> &schema,
+                             size_t threads = 0, size_t skipLines = 0, const std::string &cacheKey = "")
+        {
+            LoadCSVMarketData(paths, schema, _data, threads, skipLines, cacheKey);
+        }
+
+        CSVMarketDataManager(const CSVMarketDataManager &) = delete;
+
+        std::vector<T> &GetData()
+        {
+            return _data;
+        }
+
+        typename std::vector<T>::iterator begin()
+        {
+            return _data.begin();
+        }
+
+        typename std::vector<T>::iterator end()
+        {
+            return _data.end();
+        }
+
+    protected:
+        CSVMarketDataManager() = default;
+
+        std::vector<T> _data;
     };
 
     class CSVMarketDataTradesManager : public IMarketDataTradesManager
@@ -228,44 +809,244 @@ namespace CRPT::Core
         CSVMarketDataTradesManager(CSVMarketDataTradesManager &&) = delete;
         CSVMarketDataTradesManager(CSVMarketDataTradesManager &) = delete;
         CSVMarketDataTradesManager(const CSVMarketDataTradesManager &) = delete;
-        CSVMarketDataTradesManager(std::vector<std::string> paths)
+        CSVMarketDataTradesManager(std::vector<std::string> paths, size_t threads = 0, bool useCache = false)
         {
-            for (auto &path : paths)
-                _loadData(path);
-            _sortData();
+            LoadCSVMarketData(paths, TradesSchema(), _data, threads, 0, useCache ? SCHEMA_KEY : "");
         }
 
+        // Identifies TradesSchema in CSVCache keys, to be bumped whenever it changes
+        static constexpr const char *SCHEMA_KEY = "trades-v1";
+
         std::vector<MDTrade> &GetTrades()
         {
             return _data;
         }
 
+        // timestamp,price,qty,side,instrument[,venue]
+        static const CSVSchema<MDTrade> &TradesSchema()
+        {
+            static const CSVSchema<MDTrade> schema = CSVSchema<MDTrade>()
+                                                         .Column(0, [](std::string_view field, MDTrade &trade)
+                                                                 { trade.EventTimestamp = CSVField::ToUInt64(field); })
+                                                         .Column(1, [](std::string_view field, MDTrade &trade)
+                                                                 { trade.Price = CSVField::ToDouble(field); })
+                                                         .Column(2, [](std::string_view field, MDTrade &trade)
+                                                                 { trade.Qty = CSVField::ToDouble(field); })
+                                                         .Column(3, [](std::string_view field, MDTrade &trade)
+                                                                 { trade.AggressorSide = CSVField::IEquals(field, "buy") ? Side::Buy : Side::Sell; })
+                                                         .Column(4, [](std::string_view field, MDTrade &trade)
+                                                                 { trade.Instrument.assign(field); });
+            return schema;
+        }
+
     private:
-        void _loadData(const std::string &path)
-        {
-            auto rawLines = Helpers::ReadCSV(path);
-            for (auto &line : rawLines)
-            {
-                MDTrade update;
-                // update->Instrument = InstrumentManager::GetOrCreateInstrument(line[4], line[5]);
-                update.EventTimestamp = std::stol(line[0]);
-                update.Price = std::stod(line[1]);
-                update.Qty = std::stod(line[2]);
-                update.AggressorSide = Helpers::ToLower(line[3]) == "buy" ? Side::Buy : Side::Sell;
-                update.Instrument = line[4];
+        int _cursor{0};
+        int _size{0};
+    };
+
+    // timestamp,bid price,bid qty,ask price,ask qty,instrument
+    class CSVMarketDataL1Manager : public CSVMarketDataManager<MDL1Update>
+    {
+    public:
+        CSVMarketDataL1Manager(const std::vector<std::string> &paths, size_t threads = 0, bool useCache = false)
+            : CSVMarketDataManager(paths, QuotesSchema(), threads, 0, useCache ? SCHEMA_KEY : "")
+        {
+        }
+
+        // Identifies QuotesSchema in CSVCache keys, to be bumped whenever it changes
+        static constexpr const char *SCHEMA_KEY = "quotes-v1";
+
+        std::vector<MDL1Update> &GetUpdates()
+        {
+            return _data;
+        }
+
+        static const CSVSchema<MDL1Update> &QuotesSchema()
+        {
+            static const CSVSchema<MDL1Update> schema = CSVSchema<MDL1Update>()
+                                                            .Column(0, [](std::string_view field, MDL1Update &update)
+                                                                    { update.EventTimestamp = CSVField::ToUInt64(field); })
+                                                            .Column(1, [](std::string_view field, MDL1Update &update)
+                                                                    { update.BidPrice = CSVField::ToDouble(field); })
+                                                            .Column(2, [](std::string_view field, MDL1Update &update)
+                                                                    { update.BidQty = CSVField::ToDouble(field); })
+                                                            .Column(3, [](std::string_view field, MDL1Update &update)
+                                                                    { update.AskPrice = CSVField::ToDouble(field); })
+                                                            .Column(4, [](std::string_view field, MDL1Update &update)
+                                                                    { update.AskQty = CSVField::ToDouble(field); })
+                                                            .Column(5, [](std::string_view field, MDL1Update &update)
+                                                                    { update.Instrument.assign(field); });
+            return schema;
+        }
+    };
+
+    // Depth files with one changed level per line: timestamp,is_snapshot,side,price,qty,instrument
+    // where is_snapshot is 0 or 1 and side is buy or sell. Consecutive lines sharing their
+    // timestamp, instrument and snapshot flag form one MDL2Update.
+    class CSVMarketDataL2Manager
+    {
+    public:
+        CSVMarketDataL2Manager(const std::vector<std::string> &paths, size_t threads = 0)
+        {
+            std::vector<DepthLine> lines;
+            LoadCSVMarketData(paths, DepthSchema(), lines, threads);
+
+            std::vector<MDL2Level> asks, bids;
+            for (size_t first = 0, last = 0; first < lines.size(); first = last)
+            {
+                asks.clear();
+                bids.clear();
+                for (last = first; last < lines.size() && lines[last].EventTimestamp == lines[first].EventTimestamp &&
+                                   lines[last].Snapshot == lines[first].Snapshot &&
+                                   lines[last].Instrument == lines[first].Instrument;
+                     ++last)
+                    (lines[last].LevelSide == Side::Buy ? bids : asks).push_back({lines[last].Price, lines[last].Qty});
+
+                MDL2Update update;
+                update.EventTimestamp = lines[first].EventTimestamp;
+                update.Snapshot = lines[first].Snapshot;
+                update.Instrument = lines[first].Instrument;
+                update.Ask = asks;
+                update.Bid = bids;
                 _data.push_back(update);
             }
         }
 
-        inline void _sortData()
+        CSVMarketDataL2Manager(const CSVMarketDataL2Manager &) = delete;
+
+        MDL2Updates &GetUpdates()
         {
-            // Quite time consuming, but this application is not latency-sensitive
-            std::sort(_data.begin(), _data.end(), [](MDTrade &a, MDTrade &b)
-                      { return a.EventTimestamp < b.EventTimestamp; });
+            return _data;
         }
 
     private:
-        int _cursor{0};
-        int _size{0};
+        struct DepthLine : public MarketDataUpdate
+        {
+            bool Snapshot;
+            Side LevelSide;
+            double Price;
+            double Qty;
+            InstrumentPtr Instrument;
+        };
+
+        static const CSVSchema<DepthLine> &DepthSchema()
+        {
+            static const CSVSchema<DepthLine> schema = CSVSchema<DepthLine>()
+                                                           .Column(0, [](std::string_view field, DepthLine &line)
+                                                                   { line.EventTimestamp = CSVField::ToUInt64(field); })
+                                                           .Column(1, [](std::string_view field, DepthLine &line)
+                                                                   { line.Snapshot = field == "1"; })
+                                                           .Column(2, [](std::string_view field, DepthLine &line)
+                                                                   { line.LevelSide = CSVField::IEquals(field, "buy") ? Side::Buy : Side::Sell; })
+                                                           .Column(3, [](std::string_view field, DepthLine &line)
+                                                                   { line.Price = CSVField::ToDouble(field); })
+                                                           .Column(4, [](std::string_view field, DepthLine &line)
+                                                                   { line.Qty = CSVField::ToDouble(field); })
+                                                           .Column(5, [](std::string_view field, DepthLine &line)
+                                                                   { line.Instrument.assign(field); });
+            return schema;
+        }
+
+        MDL2Updates _data;
+    };
+
+    // Files with a header line, timestamp in the first column and the value in valueColumn;
+    // every update gets text as its Text
+    class CSVMarketDataCustomManager : public CSVMarketDataManager<MDCustomUpdate>
+    {
+    public:
+        CSVMarketDataCustomManager(const std::vector<std::string> &paths, const std::string &text,
+                                   size_t valueColumn = 1, size_t threads = 0)
+        {
+            auto schema = CSVSchema<MDCustomUpdate>()
+                              .Column(0, [](std::string_view field, MDCustomUpdate &update)
+                                      { update.EventTimestamp = CSVField::ToUInt64(field); })
+                              .Column(valueColumn, [&text](std::string_view field, MDCustomUpdate &update)
+                                      {
+                                          update.Payload = CSVField::ToDouble(field);
+                                          update.Text = text; });
+            LoadCSVMarketData(paths, schema, _data, threads, 1);
+        }
+
+        std::vector<MDCustomUpdate> &GetUpdates()
+        {
+            return _data;
+        }
+    };
+
+    // Files with a header line and the timestamp in the first column. The payload keys are
+    // the header names of columns, only those columns are converted (all of them if empty).
+    class CSVMarketDataCustomMultipleManager : public CSVMarketDataManager<MDCustomMultipleUpdate>
+    {
+    public:
+        CSVMarketDataCustomMultipleManager(const std::vector<std::string> &paths, const std::string &text,
+                                           std::vector<std::string> columns = {}, size_t threads = 0)
+        {
+            if (paths.empty())
+                return;
+
+            auto header = CSVReader(paths[0]).Header();
+            for (size_t i = 1; i < paths.size(); ++i)
+                if (CSVReader(paths[i]).Header() != header)
+                    throw std::runtime_error("Header of " + paths[i] + " differs from " + paths[0]);
+            if (columns.empty())
+                columns.assign(header.begin() + 1, header.end());
+
+            auto schema = CSVSchema<MDCustomMultipleUpdate>()
+                              .Column(0, [&text](std::string_view field, MDCustomMultipleUpdate &update)
+                                      {
+                                          update.EventTimestamp = CSVField::ToUInt64(field);
+                                          update.Text = text; });
+            for (auto &column : columns)
+            {
+                auto it = std::find(header.begin() + 1, header.end(), column);
+                if (it == header.end())
+                    throw std::runtime_error("No column " + column + " in " + paths[0]);
+                schema.Column(it - header.begin(), [&column](std::string_view field, MDCustomMultipleUpdate &update)
+                              { update.Payload[column] = CSVField::ToDouble(field); });
+            }
+            LoadCSVMarketData(paths, schema, _data, threads, 1);
+        }
+
+        std::vector<MDCustomMultipleUpdate> &GetUpdates()
+        {
+            return _data;
+        }
+    };
+
+    // Reads a trades CSV lazily, in the format of CSVMarketDataTradesManager.
+    // The file must already be sorted by EventTimestamp.
+    class CSVMarketDataTradesSource : public IMDRowSource<MDTrade>
+    {
+    public:
+        CSVMarketDataTradesSource(const std::string &path) : m_file{path}
+        {
+            if (!m_file)
+                throw std::runtime_error("Unable to open " + path);
+        }
+
+        size_t Read(std::vector<MDTrade> &chunk, size_t maxSize) override
+        {
+            size_t count = 0;
+            while (count < maxSize && std::getline(m_file, m_line, '\n'))
+            {
+                if (m_line.empty())
+                    continue;
+                chunk.emplace_back();
+                CSVMarketDataTradesManager::TradesSchema().ParseLine(m_line, ',', chunk.back());
+                ++count;
+            }
+            return count;
+        }
+
+        void Rewind() override
+        {
+            m_file.clear();
+            m_file.seekg(0);
+        }
+
+    private:
+        std::ifstream m_file;
+        std::string m_line;
     };
-}
\ No newline at end of file
+}
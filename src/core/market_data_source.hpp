@@ -0,0 +1,310 @@
+#pragma once
+
+#include "entity.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Core
+{
+    // Pull-based producer of market data for rows that don't fit in memory.
+    // Elements must be produced in EventTimestamp order.
+    template <IsMarketDataUpdate T>
+    class IMDRowSource
+    {
+    public:
+        virtual ~IMDRowSource() = default;
+
+        // Appends up to maxSize next elements to chunk and returns their number, 0 once exhausted
+        virtual size_t Read(std::vector<T> &chunk, size_t maxSize) = 0;
+
+        // Restarts the source from its first element
+        virtual void Rewind() = 0;
+
+        // Positions the source at or before its first element with EventTimestamp >= timestamp
+        // and returns the index of the element the next Read starts at, nullopt if the source
+        // can only be read forward
+        virtual std::optional<size_t> Seek(Timestamp)
+        {
+            return std::nullopt;
+        }
+    };
+
+    template <IsMarketDataUpdate T>
+    using MDRowSourcePtr = std::shared_ptr<IMDRowSource<T>>;
+
+    template <IsMarketDataUpdate T>
+    class GeneratorMDRowSource : public IMDRowSource<T>
+    {
+    public:
+        using Generator = std::function<size_t(std::vector<T> &, size_t)>;
+
+        GeneratorMDRowSource(Generator generator, std::function<void()> rewind = std::function<void()>()) : m_generator(generator),
+                                                                                                          m_rewind(rewind)
+        {
+        }
+
+        size_t Read(std::vector<T> &chunk, size_t maxSize) override
+        {
+            return m_generator(chunk, maxSize);
+        }
+
+        void Rewind() override
+        {
+            if (!m_rewind)
+                throw std::runtime_error("Generator source can't be rewound");
+            m_rewind();
+        }
+
+    private:
+        Generator m_generator;
+        std::function<void()> m_rewind;
+    };
+
+    // Runs a producer on a background thread, its chunks are handed to the row through a
+    // queue of at most maxChunks chunks. The producer pushes chunks in EventTimestamp order
+    // and must return once push returns false, which happens when the source is rewound or
+    // destroyed. Exceptions of the producer are rethrown by Read after the queued chunks.
+    // The producer starts on the first Read, so a rewind before reading runs it once.
+    template <IsMarketDataUpdate T>
+    class BackgroundMDRowSource : public IMDRowSource<T>
+    {
+    public:
+        using Push = std::function<bool(std::vector<T> &&)>;
+        using Producer = std::function<void(const Push &)>;
+
+        BackgroundMDRowSource(Producer producer, size_t maxChunks = 4) : m_producer(producer),
+                                                                         m_maxChunks(std::max<size_t>(maxChunks, 1))
+        {
+        }
+
+        BackgroundMDRowSource(const BackgroundMDRowSource &) = delete;
+
+        ~BackgroundMDRowSource()
+        {
+            stop();
+        }
+
+        size_t Read(std::vector<T> &chunk, size_t maxSize) override
+        {
+            if (!m_started)
+                start();
+            size_t count = 0;
+            while (count < maxSize)
+            {
+                if (m_position == m_pending.size())
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_consumerCv.wait(lock, [this]()
+                                      { return !m_queue.empty() || m_done; });
+                    if (m_queue.empty())
+                    {
+                        if (m_error)
+                            std::rethrow_exception(m_error);
+                        break;
+                    }
+                    m_pending = std::move(m_queue.front());
+                    m_queue.pop_front();
+                    m_position = 0;
+                    m_producerCv.notify_one();
+                }
+
+                size_t n = std::min(maxSize - count, m_pending.size() - m_position);
+                std::move(m_pending.begin() + m_position, m_pending.begin() + m_position + n, std::back_inserter(chunk));
+                m_position += n;
+                count += n;
+            }
+            return count;
+        }
+
+        // Restarts the producer from scratch on the next Read
+        void Rewind() override
+        {
+            stop();
+            m_started = false;
+        }
+
+    private:
+        void start()
+        {
+            m_queue.clear();
+            m_pending.clear();
+            m_position = 0;
+            m_stopped = m_done = false;
+            m_error = nullptr;
+            m_started = true;
+            m_thread = std::thread([this]()
+                                   {
+                                       Push push = [this](std::vector<T> &&chunk)
+                                       {
+                                           std::unique_lock<std::mutex> lock(m_mutex);
+                                           m_producerCv.wait(lock, [this]()
+                                                             { return m_queue.size() < m_maxChunks || m_stopped; });
+                                           if (m_stopped)
+                                               return false;
+                                           if (!chunk.empty())
+                                               m_queue.push_back(std::move(chunk));
+                                           m_consumerCv.notify_one();
+                                           return true;
+                                       };
+                                       std::exception_ptr error;
+                                       try
+                                       {
+                                           m_producer(push);
+                                       }
+                                       catch (...)
+                                       {
+                                           error = std::current_exception();
+                                       }
+                                       std::lock_guard<std::mutex> lock(m_mutex);
+                                       m_error = error;
+                                       m_done = true;
+                                       m_consumerCv.notify_one(); });
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopped = true;
+                m_producerCv.notify_one();
+            }
+            if (m_thread.joinable())
+                m_thread.join();
+        }
+
+        Producer m_producer;
+        size_t m_maxChunks;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_producerCv, m_consumerCv;
+        std::deque<std::vector<T>> m_queue;
+        bool m_stopped{false}, m_done{false};
+        std::exception_ptr m_error;
+
+        // Chunk being handed out, only touched by the consumer
+        std::vector<T> m_pending;
+        size_t m_position{0};
+        bool m_started{false};
+    };
+
+    // Part of a streaming row that is currently held in memory: the chunk being read
+    // and the one before it. Pointers into a chunk stay valid until two more chunks are pulled.
+    class MDRowStream
+    {
+    public:
+        using BufferPtr = char *;
+
+        virtual ~MDRowStream() = default;
+
+        MarketDataUpdatePtr At(size_t n)
+        {
+            if (n - m_offset < m_size)
+                return (MarketDataUpdatePtr)&m_data[m_typeSize * (n - m_offset)];
+            if (n - m_prevOffset < m_prevSize)
+                return (MarketDataUpdatePtr)&m_prevData[m_typeSize * (n - m_prevOffset)];
+            if (n < m_offset)
+                throw std::runtime_error("Streaming row can't be read backwards");
+            if (!fetch(n))
+                return nullptr;
+            return (MarketDataUpdatePtr)&m_data[m_typeSize * (n - m_offset)];
+        }
+
+        // Address of element n if it is already in memory, nullptr otherwise; never pulls
+        const void *Address(size_t n) const
+        {
+            if (n - m_offset < m_size)
+                return &m_data[m_typeSize * (n - m_offset)];
+            return nullptr;
+        }
+
+        // Number of elements pulled from the source so far
+        size_t Pulled() const
+        {
+            return m_offset + m_size;
+        }
+
+        virtual void Rewind() = 0;
+
+        // Skips ahead through the source, see IMDRowSource::Seek
+        virtual std::optional<size_t> Seek(Timestamp timestamp) = 0;
+
+    protected:
+        MDRowStream(size_t typeSize) : m_typeSize(typeSize)
+        {
+        }
+
+        // Pulls chunks until element n is in the current one, false if the source ends before it
+        virtual bool fetch(size_t n) = 0;
+
+        BufferPtr m_data{nullptr}, m_prevData{nullptr};
+        size_t m_offset{0}, m_size{0};
+        size_t m_prevOffset{0}, m_prevSize{0};
+        size_t m_typeSize;
+    };
+
+    template <IsMarketDataUpdate T>
+    class ChunkedMDRowStream : public MDRowStream
+    {
+    public:
+        ChunkedMDRowStream(MDRowSourcePtr<T> source, size_t chunkSize) : MDRowStream(sizeof(T)),
+                                                                         m_source(source),
+                                                                         m_chunkSize(std::max<size_t>(chunkSize, 1))
+        {
+            m_current.reserve(m_chunkSize);
+            m_previous.reserve(m_chunkSize);
+        }
+
+        void Rewind() override
+        {
+            m_source->Rewind();
+            m_current.clear();
+            m_previous.clear();
+            m_data = m_prevData = nullptr;
+            m_offset = m_size = m_prevOffset = m_prevSize = 0;
+            m_exhausted = false;
+        }
+
+        std::optional<size_t> Seek(Timestamp timestamp) override
+        {
+            auto position = m_source->Seek(timestamp);
+            if (!position)
+                return std::nullopt;
+            m_current.clear();
+            m_previous.clear();
+            m_data = m_prevData = nullptr;
+            m_offset = *position;
+            m_size = m_prevOffset = m_prevSize = 0;
+            m_exhausted = false;
+            return position;
+        }
+
+    protected:
+        bool fetch(size_t n) override
+        {
+            while (n >= m_offset + m_size)
+            {
+                if (m_exhausted)
+                    return false;
+
+                // The oldest chunk is recycled to receive the next one
+                std::swap(m_current, m_previous);
+                m_prevData = BufferPtr(m_previous.data());
+                m_prevOffset = m_offset;
+                m_prevSize = m_size;
+                m_offset += m_size;
+
+                m_current.clear();
+                if (m_source->Read(m_current, m_chunkSize) == 0)
+                    m_exhausted = true;
+                m_data = BufferPtr(m_current.data());
+                m_size = m_current.size();
+            }
+            return true;
+        }
+
+    private:
+        MDRowSourcePtr<T> m_source;
+        size_t m_chunkSize;
+        std::vector<T> m_current, m_previous;
+        bool m_exhausted{false};
+    };
+}
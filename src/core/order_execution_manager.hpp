@@ -6,144 +6,428 @@ namespace CRPT::Core
 {
     using namespace CRPT::Utils;
 
+    // Resting orders at one price, in arrival order. Orders are linked through their
+    // Book* fields, nothing is allocated per order, only a map node per new price level.
+    // Consumed counts the market quantity printed or canceled at the price since the level
+    // was created, Displayed and Printed the displayed quantity and the quantity printed at
+    // the price since it was last displayed.
+    struct PriceLevel
+    {
+        double Price;
+        OrderPtr Head{nullptr};
+        OrderPtr Tail{nullptr};
+        std::map<double, PriceLevel *>::iterator Position;
+        double Consumed{0};
+        double Displayed{0};
+        double Printed{0};
+    };
+
+    // Execution of a resting order, FilledQty is the cumulative quantity after it
+    struct OrderFill
+    {
+        OrderPtr Order;
+        double Qty;
+        double Price;
+        double FilledQty;
+    };
+
     class OrderExecutionManager
     {
     public:
-        void AddNewOrder(OrderPtr order)
+        OrderExecutionManager() = default;
+        OrderExecutionManager(const OrderExecutionManager &) = delete;
+
+        // Queue position model: an order joining a level queues behind the market quantity
+        // displayed at its price, which prints and cancels at the price consume before the
+        // order can fill. Prints through the price fill it regardless.
+        void SetQueuePositionModel(bool enabled)
         {
-            if (order->Type == OrderType::Limit)
-            {
-                if ((order->OrderSide == Side::Buy && m_lastSellMarketPrice < order->Price) ||
-                    (order->OrderSide == Side::Sell && m_lastBuyMarketPrice > order->Price))
-                    order->Type = OrderType::Market;
-            }
-            order->OrderSide == Side::Buy ? m_bid.push(order) : m_ask.push(order);
-            if (order->Type == OrderType::Market)
-                order->Price = order->OrderSide == Side::Buy ? MAXPRICE : 0.;
+            m_queuePositions = enabled;
         }
 
-        std::vector<OrderPtr> MatchWithPrice(double price, Side side)
+        // displayedQty is the market quantity displayed at the price of the order, only
+        // used by the queue position model
+        void AddNewOrder(OrderPtr order, double displayedQty = 0)
         {
-            // Always filling our orders in full, no partial fills
-            std::vector<OrderPtr> result;
+            convertMarketable(order);
+            order->BookQty = order->Qty - order->FilledQty;
+            insert(order, displayedQty);
+        }
+
+        // Fills resting orders crossing price in priority order until qty is consumed and
+        // appends the fills to fills, returns the quantity consumed. Orders keep their
+        // FilledQty and LastExecPrice, the fills are applied to them when reported.
+        double MatchWithPrice(double price, Side side, double qty, std::vector<OrderFill> &fills)
+        {
+            qty = clampQty(qty);
+            double initialQty = qty;
             if (side == Side::Sell)
             {
                 m_lastSellMarketPrice = price;
-                while (!m_bid.empty() && (m_bid.top()->Price >= price || m_bid.top()->Type == OrderType::Market))
-                {
-                    result.push_back(m_bid.top());
-                    m_bid.pop();
-                    result.back()->FilledQty = result.back()->Qty;
-                    if (result.back()->Type == OrderType::Market)
-                        result.back()->LastExecPrice = price;
-                    else
-                        result.back()->LastExecPrice = result.back()->Price;
-                }
+                while (qty > 0 && crosses(price, side))
+                    fillLevel(m_bids.rbegin()->second, price, qty, fills);
             }
             else if (side == Side::Buy)
             {
                 m_lastBuyMarketPrice = price;
-                while (!m_ask.empty() && (m_ask.top()->Price <= price || m_ask.top()->Type == OrderType::Market))
-                {
-                    result.push_back(m_ask.top());
-                    m_ask.pop();
-                    result.back()->FilledQty = result.back()->Qty;
-                    if (result.back()->Type == OrderType::Market)
-                        result.back()->LastExecPrice = price;
-                    else
-                        result.back()->LastExecPrice = result.back()->Price;
-                }
+                while (qty > 0 && crosses(price, side))
+                    fillLevel(m_asks.begin()->second, price, qty, fills);
             }
-            return result;
+            return initialQty - qty;
         }
 
-        void ReplaceOrder(OrderPtr order, double price, double qty)
+        // Matches against the top of the market on the side that trades with side. When
+        // limitQty is set the top level trades its displayed quantity less what earlier
+        // matches already took from it, so an unchanged level does not fill twice.
+        void MatchWithTop(double price, double qty, Side side, bool limitQty, std::vector<OrderFill> &fills)
         {
-            if (order->OrderSide == Side::Buy)
+            if (!limitQty)
             {
-                std::vector<OrderPtr> buffer;
-                while (!m_bid.empty())
-                {
-                    buffer.push_back(m_bid.top());
-                    m_bid.pop();
-                }
-                while (!buffer.empty())
-                {
-                    m_bid.push(buffer.back());
-                    buffer.pop_back();
-                }
+                MatchWithPrice(price, side, MAXQTY, fills);
+                return;
+            }
+            // Quantity taken from former top levels is not tracked once the top moves
+            auto &taken = takenQty(side);
+            std::erase_if(taken, [price](const TakenQty &level) { return level.Price != price; });
+            matchDisplayed(taken, price, qty, side, fills);
+        }
+
+        // Matches against displayed depth given worst level first and best last, as L2Book
+        // stores it, on the side of the book that trades with side: every level crossing
+        // resting orders trades like a print at its price. When limitQty is set a level trades
+        // its quantity less what earlier matches already took from it, so levels an update
+        // leaves unchanged do not fill again.
+        void MatchWithLevels(std::span<const double> prices, std::span<const double> qtys, Side side,
+                             bool limitQty, std::vector<OrderFill> &fills)
+        {
+            auto &taken = takenQty(side);
+            if (limitQty)
+            {
+                // Levels gone from the depth take their taken quantity with them
+                std::erase_if(taken, [&](TakenQty &level) {
+                    double qty = levelQty(prices, qtys, side, level.Price);
+                    level.Qty = std::min(level.Qty, qty);
+                    return qty == 0;
+                });
+            }
+            if (prices.empty())
+                return;
+            for (size_t i = prices.size(); i-- > 0 && crosses(prices[i], side);)
+            {
+                if (limitQty)
+                    matchDisplayed(taken, prices[i], qtys[i], side, fills);
+                else
+                    MatchWithPrice(prices[i], side, MAXQTY, fills);
             }
+            if (side == Side::Sell)
+                m_lastSellMarketPrice = prices.back();
             else
+                m_lastBuyMarketPrice = prices.back();
+        }
+
+        // Fills every order crossing price in full and applies the fills
+        std::vector<OrderPtr> MatchWithPrice(double price, Side side)
+        {
+            std::vector<OrderFill> fills;
+            MatchWithPrice(price, side, MAXQTY, fills);
+            std::vector<OrderPtr> result;
+            result.reserve(fills.size());
+            for (auto &fill : fills)
             {
-                std::vector<OrderPtr> buffer;
-                while (!m_ask.empty())
-                {
-                    buffer.push_back(m_ask.top());
-                    m_ask.pop();
-                }
-                while (!buffer.empty())
-                {
-                    m_ask.push(buffer.back());
-                    buffer.pop_back();
-                }
+                fill.Order->FilledQty = fill.FilledQty;
+                fill.Order->LastExecPrice = fill.Price;
+                result.push_back(fill.Order);
             }
+            return result;
+        }
+
+        // Amends a resting order, false if it is no longer in the book or qty does not exceed
+        // its filled quantity. A new price moves the order to the back of its new level, a
+        // larger quantity to the back of its level, and a smaller quantity keeps its place.
+        // Market orders keep their price. displayedQty is the market quantity displayed at
+        // the new price, as for AddNewOrder. A new limit price through the market makes the
+        // order a market order, as for AddNewOrder.
+        bool ReplaceOrder(OrderPtr order, double price, double qty, double displayedQty = 0)
+        {
+            double filledQty = order->Qty - order->BookQty;
+            if (!order->BookLevel || qty - filledQty < QTY_EPSILON)
+                return false;
+            if (order->Type == OrderType::Market)
+                price = order->Price;
+
+            bool requeue = price != order->Price || qty > order->Qty;
+            order->Qty = qty;
+            order->BookQty = qty - filledQty;
+            if (requeue)
+            {
+                remove(order);
+                order->Price = price;
+                convertMarketable(order);
+                insert(order, displayedQty);
+            }
+            return true;
         }
 
         void CancelOrder(OrderPtr order)
         {
-            if (order->OrderSide == Side::Buy)
+            if (order->BookLevel)
+                remove(order);
+        }
+
+        // Market quantity displayed at price on side, for the queue position model. Drops
+        // not explained by prints at the price since the last update count as cancels ahead
+        // of our orders.
+        void UpdateDisplayedQty(Side side, double price, double qty)
+        {
+            auto &levels = book(side);
+            auto position = levels.find(price);
+            if (position != levels.end())
+                updateDisplayed(position->second, qty);
+        }
+
+        // Top of the market on side: our levels at better prices have nothing displayed
+        // ahead of them anymore
+        void UpdateDisplayedTop(Side side, double price, double qty)
+        {
+            if (side == Side::Buy)
             {
-                std::vector<OrderPtr> buffer;
-                while (!m_bid.empty())
-                {
-                    if (m_bid.top() != order)
-                        buffer.push_back(m_bid.top());
-                    m_bid.pop();
-                }
-                while (!buffer.empty())
-                {
-                    m_bid.push(buffer.back());
-                    buffer.pop_back();
-                }
+                for (auto level = m_bids.rbegin(); level != m_bids.rend() && level->first > price; ++level)
+                    updateDisplayed(level->second, 0);
             }
             else
             {
-                std::vector<OrderPtr> buffer;
-                while (!m_ask.empty())
-                {
-                    if (m_ask.top() != order)
-                        buffer.push_back(m_ask.top());
-                    m_ask.pop();
-                }
-                while (!buffer.empty())
-                {
-                    m_ask.push(buffer.back());
-                    buffer.pop_back();
-                }
+                for (auto level = m_asks.begin(); level != m_asks.end() && level->first < price; ++level)
+                    updateDisplayed(level->second, 0);
             }
+            UpdateDisplayedQty(side, price, qty);
+        }
+
+        // Displayed depth from a depth update: only the levels of a delta are looked up, a
+        // snapshot, best level first as for L2Book, is merged with our levels in one pass
+        void UpdateDisplayedDepth(const MDL2Update &update)
+        {
+            if (update.Snapshot)
+            {
+                updateDisplayedSnapshot(m_bids.rbegin(), m_bids.rend(), update.Bid, std::greater<double>());
+                updateDisplayedSnapshot(m_asks.begin(), m_asks.end(), update.Ask, std::less<double>());
+                return;
+            }
+            for (auto &level : update.Bid)
+                UpdateDisplayedQty(Side::Buy, level.Price, level.Qty);
+            for (auto &level : update.Ask)
+                UpdateDisplayedQty(Side::Sell, level.Price, level.Qty);
+        }
+
+        // Best resting prices, MAXPRICE for a market buy and 0 for a market sell
+        std::optional<double> GetBestBid() const
+        {
+            if (m_bids.empty())
+                return std::nullopt;
+            return m_bids.rbegin()->first;
+        }
+
+        std::optional<double> GetBestAsk() const
+        {
+            if (m_asks.empty())
+                return std::nullopt;
+            return m_asks.begin()->first;
         }
 
     private:
-        struct AskComparator
+        // A limit order through the last market prices trades as a market order
+        void convertMarketable(OrderPtr order) const
         {
-            bool operator()(const OrderPtr &a, const OrderPtr &b) const
+            if (order->Type == OrderType::Limit)
             {
-                return a->Price > b->Price;
+                if ((order->OrderSide == Side::Buy && m_lastSellMarketPrice < order->Price) ||
+                    (order->OrderSide == Side::Sell && m_lastBuyMarketPrice > order->Price))
+                    order->Type = OrderType::Market;
             }
+            if (order->Type == OrderType::Market)
+                order->Price = order->OrderSide == Side::Buy ? MAXPRICE : 0.;
+        }
+
+        // Market quantity of a displayed level taken by our orders
+        struct TakenQty
+        {
+            double Price;
+            double Qty;
         };
 
-        struct BidComparator
+        std::vector<TakenQty> &takenQty(Side side)
         {
-            bool operator()(const OrderPtr &a, const OrderPtr &b) const
+            return side == Side::Buy ? m_takenBids : m_takenAsks;
+        }
+
+        // Quantity of the level at price in depth given worst level first, 0 if it is not there
+        static double levelQty(std::span<const double> prices, std::span<const double> qtys, Side side, double price)
+        {
+            // Sell side matches walk the asks, stored by descending price
+            auto position = side == Side::Sell
+                                ? std::lower_bound(prices.begin(), prices.end(), price, std::greater<double>())
+                                : std::lower_bound(prices.begin(), prices.end(), price);
+            if (position == prices.end() || *position != price)
+                return 0;
+            return qtys[position - prices.begin()];
+        }
+
+        // A level shrinking below the quantity taken from it has lost that quantity, only
+        // quantity displayed on top of it is new
+        void matchDisplayed(std::vector<TakenQty> &taken, double price, double qty, Side side,
+                            std::vector<OrderFill> &fills)
+        {
+            auto level = std::find_if(taken.begin(), taken.end(),
+                                      [price](const TakenQty &level) { return level.Price == price; });
+            double takenQty = 0;
+            if (level != taken.end())
+                takenQty = level->Qty = std::min(level->Qty, qty);
+            double matched = MatchWithPrice(price, side, qty - takenQty, fills);
+            if (level != taken.end())
+                level->Qty += matched;
+            else if (matched > 0)
+                taken.push_back({price, matched});
+        }
+
+        bool crosses(double price, Side side) const
+        {
+            if (side == Side::Sell)
+                return !m_bids.empty() && m_bids.rbegin()->first >= price;
+            return !m_asks.empty() && m_asks.begin()->first <= price;
+        }
+
+        std::map<double, PriceLevel *> &book(Side side)
+        {
+            return side == Side::Buy ? m_bids : m_asks;
+        }
+
+        void insert(OrderPtr order, double displayedQty)
+        {
+            auto &levels = book(order->OrderSide);
+            auto [position, inserted] = levels.try_emplace(order->Price, nullptr);
+            if (inserted)
             {
-                return a->Price < b->Price;
+                position->second = newLevel();
+                position->second->Price = order->Price;
+                position->second->Position = position;
+                position->second->Displayed = displayedQty;
             }
-        };
 
-        std::priority_queue<OrderPtr, std::vector<OrderPtr>, AskComparator> m_ask;
-        std::priority_queue<OrderPtr, std::vector<OrderPtr>, BidComparator> m_bid;
+            PriceLevel *level = position->second;
+            order->QueuePosition = level->Consumed + (m_queuePositions ? displayedQty : 0);
+            order->BookLevel = level;
+            order->BookPrev = level->Tail;
+            order->BookNext = nullptr;
+            if (level->Tail)
+                level->Tail->BookNext = order;
+            else
+                level->Head = order;
+            level->Tail = order;
+        }
+
+        void remove(OrderPtr order)
+        {
+            PriceLevel *level = order->BookLevel;
+            if (order->BookPrev)
+                order->BookPrev->BookNext = order->BookNext;
+            else
+                level->Head = order->BookNext;
+            if (order->BookNext)
+                order->BookNext->BookPrev = order->BookPrev;
+            else
+                level->Tail = order->BookPrev;
+            order->BookLevel = nullptr;
+            order->BookPrev = order->BookNext = nullptr;
+
+            if (!level->Head)
+            {
+                book(order->OrderSide).erase(level->Position);
+                m_freeLevels.push_back(level);
+            }
+        }
+
+        void fillLevel(PriceLevel *level, double price, double &qty, std::vector<OrderFill> &fills)
+        {
+            // Removing the last order releases the level
+            bool queued = m_queuePositions && level->Price == price;
+            bool last = false;
+            while (!last && qty > 0)
+            {
+                OrderPtr order = level->Head;
+                if (queued && order->QueuePosition - level->Consumed > QTY_EPSILON)
+                {
+                    double ahead = std::min(qty, order->QueuePosition - level->Consumed);
+                    level->Consumed += ahead;
+                    level->Printed += ahead;
+                    qty = clampQty(qty - ahead);
+                    if (qty == 0)
+                        return;
+                }
+                // A leftover below QTY_EPSILON completes the order
+                double fillQty = order->BookQty - qty < QTY_EPSILON ? order->BookQty : qty;
+                qty = clampQty(qty - fillQty);
+                order->BookQty -= fillQty;
+                fills.push_back({order, fillQty, order->Type == OrderType::Market ? price : order->Price,
+                                 order->Qty - order->BookQty});
+                if (order->BookQty > 0)
+                    return;
+                last = order == level->Tail;
+                remove(order);
+            }
+        }
+
+        static double clampQty(double qty)
+        {
+            return qty < QTY_EPSILON ? 0 : qty;
+        }
+
+        // Our levels from best to worst against the snapshot levels of the side, our levels
+        // missing from the snapshot have nothing displayed
+        template <class Levels, class Better>
+        void updateDisplayedSnapshot(Levels level, Levels end, std::span<const MDL2Level> snapshot, Better better)
+        {
+            size_t n = 0;
+            for (; level != end; ++level)
+            {
+                while (n < snapshot.size() && better(snapshot[n].Price, level->first))
+                    ++n;
+                updateDisplayed(level->second, n < snapshot.size() && snapshot[n].Price == level->first ? snapshot[n].Qty : 0);
+            }
+        }
+
+        void updateDisplayed(PriceLevel *level, double qty)
+        {
+            double canceled = level->Displayed - qty - level->Printed;
+            if (canceled > 0)
+                level->Consumed += canceled;
+            level->Displayed = qty;
+            level->Printed = 0;
+        }
+
+        PriceLevel *newLevel()
+        {
+            if (m_freeLevels.empty())
+                return &m_levels.emplace_back();
+            PriceLevel *level = m_freeLevels.back();
+            m_freeLevels.pop_back();
+            *level = PriceLevel{};
+            return level;
+        }
+
+        // Levels keyed by price, the best bid is the last one and the best ask the first one
+        std::map<double, PriceLevel *> m_bids;
+        std::map<double, PriceLevel *> m_asks;
+
+        // Level storage with stable addresses, emptied levels are reused
+        std::deque<PriceLevel> m_levels;
+        std::vector<PriceLevel *> m_freeLevels;
+
+        // Quantity taken from displayed market levels, bids by buy side matches and asks by
+        // sell side matches
+        std::vector<TakenQty> m_takenBids;
+        std::vector<TakenQty> m_takenAsks;
 
         double m_lastBuyMarketPrice{0};
         double m_lastSellMarketPrice{MAXPRICE};
+        bool m_queuePositions{false};
     };
-}
\ No newline at end of file
+}
@@ -1,3 +1,5 @@
+#include "journal.hpp"
+#include "l2_book.hpp"
 #include "market_data_simulation_manager.hpp"
 #include "order_execution_manager.hpp"
 #include "../utils/circular_buffer.hpp"
@@ -37,7 +39,7 @@ namespace CRPT::Core
         {
             order->State = OrderState::PendingNew;
             order->CreateTimestamp = m_currentTimestamp;
-            m_input_order_queue.PushBack(order);
+            push(m_input_order_queue, order);
         }
 
         void OnCancelOrder(OrderPtr order)
@@ -45,13 +47,13 @@ namespace CRPT::Core
             if (order->State != OrderState::Filled && order->State != OrderState::Canceled)
             {
                 order->State = OrderState::PendingCancel;
-                m_input_order_cancel_queue.PushBack(order);
+                push(m_input_order_cancel_queue, order);
             }
         }
 
         void OnOrderReplace(OrderPtr order, double price, double qty)
         {
-            m_input_replaced_orders_queue.PushBack(std::make_tuple(order, price, qty, m_currentTimestamp));
+            push(m_input_replaced_orders_queue, std::make_tuple(order, price, qty, m_currentTimestamp));
         }
 
         Timestamp GetCurrentTimestamp()
@@ -64,55 +66,252 @@ namespace CRPT::Core
             return m_nextTimestamp;
         }
 
+        // Opt-in batching: events sharing an EventTimestamp are processed in a single step,
+        // and the market data delivered in a step is passed to this callback at once
+        // instead of the per-type market data callbacks
+        void SetBatchCallback(std::function<void(std::span<const MarketDataUpdatePtr>)> md_batch_callback)
+        {
+            m_md_batch_callback = md_batch_callback;
+        }
+
+        // Opt-in queue position model, see OrderExecutionManager::SetQueuePositionModel. The
+        // displayed quantities come from L1 and L2 updates and the queue is consumed by the
+        // quantities of prints, so fills are quantity-aware as with SetPartialFills. Call it
+        // before sending orders.
+        void SetQueuePositionModel(bool enabled)
+        {
+            m_queuePositions = enabled;
+            for (auto &[instrument, manager] : m_order_exection_manager)
+                manager.SetQueuePositionModel(enabled);
+        }
+
+        // Depth updates are matched against on arrival and reach this callback after the
+        // market data latency; a strategy keeps its own view by applying them to an L2Book
+        void SetL2UpdateCallback(std::function<void(MDL2UpdatePtr)> md_l2_callback)
+        {
+            m_md_l2_callback = md_l2_callback;
+        }
+
+        // Opt-in quantity-aware matching: each trade fills our resting orders up to its Qty and
+        // each L1 update up to the displayed quantity, orders left with quantity are reported as
+        // PartiallyFilled.
+        // By default crossing orders are filled in full.
+        void SetPartialFills(bool enabled)
+        {
+            m_partialFills = enabled;
+        }
+
+        // Opt-in: throw when an element doesn't fit into a full queue, by default it's dropped.
+        // Market data and fills are dropped only when QueueSize of them are still in flight.
+        void SetThrowOnQueueOverflow(bool enabled)
+        {
+            m_throwOnQueueOverflow = enabled;
+        }
+
+        // Order events reported to the strategy are also recorded to the journal,
+        // the journal must outlive the simulation runs
+        void SetJournal(Journal *journal)
+        {
+            m_journal = journal;
+        }
+
         void Run()
         {
-            for (auto iter = m_marketDataManager.begin(); iter != m_marketDataManager.end(); ++iter)
+            if (m_md_batch_callback)
             {
-                m_currentTimestamp = iter->EventTimestamp;
-                if (iter + 1 != m_marketDataManager.end())
-                    m_nextTimestamp = (iter + 1)->EventTimestamp;
-                processInputMessages(*iter);
-                processMDTypeSpecificInfo(*iter);
-                processOutputQueues(*iter);
+                runBatched();
+                return;
+            }
+
+            auto end = m_marketDataManager.end();
+            for (auto iter = m_marketDataManager.begin(); iter != end; ++iter)
+            {
+                m_currentTimestamp = iter.CurrentTimestamp();
+                if (iter.HasNext())
+                    m_nextTimestamp = iter.PeekNextTimestamp();
+                processInputMessages(m_currentTimestamp);
+                processMDUpdate(iter);
+                processOutputQueues(m_currentTimestamp);
             }
         }
 
     private:
+        void runBatched()
+        {
+            auto end = m_marketDataManager.end();
+            auto iter = m_marketDataManager.begin();
+            while (iter != end)
+            {
+                m_currentTimestamp = iter.CurrentTimestamp();
+                processInputMessages(m_currentTimestamp);
+                bool sameTimestamp;
+                do
+                {
+                    processMDUpdate(iter);
+                    sameTimestamp = iter.HasNext() && iter.PeekNextTimestamp() == m_currentTimestamp;
+                    ++iter;
+                } while (sameTimestamp);
+
+                // The group is drained once, queues filled up by longer bursts were flushed
+                // on the way, see pushOutput
+                if (iter != end)
+                    m_nextTimestamp = iter.CurrentTimestamp();
+                processOutputQueues(m_currentTimestamp);
+
+                if (!m_delivered.empty())
+                {
+                    m_md_batch_callback(std::span<const MarketDataUpdatePtr>(m_delivered));
+                    m_delivered.clear();
+                    m_materialized.clear();
+                }
+            }
+        }
+
+        // An element pushed to a full queue is dropped, or throws with SetThrowOnQueueOverflow
+        template <class Queue, class T>
+        void push(Queue &queue, const T &element)
+        {
+            if (!queue.PushBack(element) && m_throwOnQueueOverflow)
+                throw std::runtime_error("Simulation queue is full, QueueSize " + std::to_string(QueueSize) + " is too small");
+        }
+
+        // Market data and fills go through here: a full queue is first flushed at the current
+        // timestamp, so bursts of events sharing a timestamp don't overflow it
+        template <class Queue, class T>
+        void pushOutput(Queue &queue, const T &element)
+        {
+            if (queue.Full())
+                processOutputQueues(m_currentTimestamp);
+            push(queue, element);
+        }
+
+        void record(JournalEvent event, OrderPtr order)
+        {
+            if (m_journal)
+                m_journal->Record(event, *order, m_currentTimestamp);
+        }
+
+        void reportFill(const OrderFill &fill)
+        {
+            OrderPtr order = fill.Order;
+            order->LastReportTimestamp = m_currentTimestamp;
+            order->FilledQty = fill.FilledQty;
+            order->LastExecPrice = fill.Price;
+            order->State = fill.FilledQty < order->Qty ? OrderState::PartiallyFilled : OrderState::Filled;
+            record(order->State == OrderState::Filled ? JournalEvent::Filled : JournalEvent::PartiallyFilled, order);
+            m_executed_order_callback(order);
+        }
+
+        void deliver(MarketDataUpdatePtr update)
+        {
+            m_delivered.push_back(update);
+        }
+
         void processMDUpdate(MDTradePtr trade)
         {
-            m_output_md_trades_queue.PushBack(trade);
+            pushOutput(m_output_md_trades_queue, trade);
             trade->LocalTimestamp = trade->EventTimestamp + m_marketDataLatency;
-            auto result = m_order_exection_manager[trade->Instrument].MatchWithPrice(trade->Price, trade->AggressorSide);
+            executionManager(trade->Instrument).MatchWithPrice(trade->Price, trade->AggressorSide,
+                                                               limitQty() ? trade->Qty : MAXQTY, m_fills);
+            queueFills();
+        }
 
-            for (auto &order : result)
-                if (order->State != OrderState::PendingCancel && order->State != OrderState::Canceled)
-                    m_output_executed_orders_queue.PushBack(order);
+        // Columnar trades are matched from the columns, the MDTrade is built on delivery and
+        // only when a callback takes it
+        void processMDUpdate(const MDTradeColumns &columns, size_t n)
+        {
+            if (m_md_batch_callback || m_md_trade_callback)
+                pushOutput(m_output_md_columnar_trades_queue, std::make_pair(&columns, n));
+            executionManager(columns.Instruments[columns.InstrumentIds[n]])
+                .MatchWithPrice(columns.Prices[n], columns.AggressorSides[n], limitQty() ? columns.Qtys[n] : MAXQTY, m_fills);
+            queueFills();
         }
 
         void processMDUpdate(MDL1UpdatePtr update)
         {
-            m_output_md_l1_updates_queue.PushBack(update);
+            pushOutput(m_output_md_l1_updates_queue, update);
             update->LocalTimestamp = update->EventTimestamp + m_marketDataLatency;
-            auto resultBuy = m_order_exection_manager[update->Instrument].MatchWithPrice(update->AskPrice, Side::Sell);
+            auto &manager = executionManager(update->Instrument);
+            if (m_queuePositions)
+            {
+                m_tops[update->Instrument] = {update->BidPrice, update->BidQty, update->AskPrice, update->AskQty};
+                manager.UpdateDisplayedTop(Side::Buy, update->BidPrice, update->BidQty);
+                manager.UpdateDisplayedTop(Side::Sell, update->AskPrice, update->AskQty);
+            }
+            manager.MatchWithTop(update->AskPrice, update->AskQty, Side::Sell, limitQty(), m_fills);
+            manager.MatchWithTop(update->BidPrice, update->BidQty, Side::Buy, limitQty(), m_fills);
+            queueFills();
+        }
+
+        bool limitQty() const
+        {
+            return m_partialFills || m_queuePositions;
+        }
 
-            for (auto &order : resultBuy)
-                if (order->State != OrderState::PendingCancel && order->State != OrderState::Canceled)
-                    m_output_executed_orders_queue.PushBack(order);
+        OrderExecutionManager &executionManager(const InstrumentPtr &instrument)
+        {
+            auto [position, inserted] = m_order_exection_manager.try_emplace(instrument);
+            if (inserted)
+                position->second.SetQueuePositionModel(m_queuePositions);
+            return position->second;
+        }
 
-            auto resultSell = m_order_exection_manager[update->Instrument].MatchWithPrice(update->BidPrice, Side::Buy);
-            for (auto &order : resultSell)
-                if (order->State != OrderState::PendingCancel && order->State != OrderState::Canceled)
-                    m_output_executed_orders_queue.PushBack(order);
+        // Market quantity displayed at price, from the depth of the instrument when it has
+        // any and from its top of book otherwise, where deeper levels count as empty
+        double displayedQty(const InstrumentPtr &instrument, Side side, double price) const
+        {
+            if (!m_queuePositions)
+                return 0;
+            if (auto book = m_l2_books.find(instrument); book != m_l2_books.end())
+                return book->second.GetQty(side, price);
+            if (auto top = m_tops.find(instrument); top != m_tops.end())
+            {
+                auto &[bidPrice, bidQty, askPrice, askQty] = top->second;
+                if (side == Side::Buy)
+                    return price == bidPrice ? bidQty : 0;
+                return price == askPrice ? askQty : 0;
+            }
+            return 0;
+        }
+
+        void queueFills()
+        {
+            for (auto &fill : m_fills)
+                if (fill.Order->State != OrderState::PendingCancel && fill.Order->State != OrderState::Canceled)
+                    pushOutput(m_output_executed_orders_queue, fill);
+            m_fills.clear();
+        }
+
+        void processMDUpdate(MDL2UpdatePtr update)
+        {
+            pushOutput(m_output_md_l2_updates_queue, update);
+            update->LocalTimestamp = update->EventTimestamp + m_marketDataLatency;
+            auto &book = m_l2_books[update->Instrument];
+            book.Apply(*update);
+            auto &manager = executionManager(update->Instrument);
+            if (m_queuePositions)
+                manager.UpdateDisplayedDepth(*update);
+            manager.MatchWithLevels(book.AskPrices(), book.AskQtys(), Side::Sell, limitQty(), m_fills);
+            manager.MatchWithLevels(book.BidPrices(), book.BidQtys(), Side::Buy, limitQty(), m_fills);
+            queueFills();
         }
 
         void processMDUpdate(MDCustomUpdatePtr update)
         {
-            m_output_md_custom_updates_queue.PushBack(update);
+            pushOutput(m_output_md_custom_updates_queue, update);
         }
 
         void processMDUpdate(MDCustomMultipleUpdatePtr update)
         {
-            m_output_md_custom_multiple_updates_queue.PushBack(update);
+            pushOutput(m_output_md_custom_multiple_updates_queue, update);
+        }
+
+        void processMDUpdate(MarketDataSimulationManager::iterator &iter)
+        {
+            if (auto columns = iter.CurrentColumns())
+                processMDUpdate(*columns, iter.CurrentIndex());
+            else
+                processMDTypeSpecificInfo(*iter);
         }
 
         void processMDTypeSpecificInfo(MarketDataUpdatePtr update)
@@ -129,6 +328,11 @@ namespace CRPT::Core
                 processMDUpdate(MDL1UpdatePtr(update));
                 return;
             }
+            case MarketDataType::L2Update:
+            {
+                processMDUpdate(MDL2UpdatePtr(update));
+                return;
+            }
             case MarketDataType::Custom:
             {
                 processMDUpdate(MDCustomUpdatePtr(update));
@@ -146,119 +350,170 @@ namespace CRPT::Core
             }
         }
 
-        void processInputMessages(MarketDataUpdatePtr update)
+        void processInputMessages(Timestamp timestamp)
         {
             while (!m_input_order_queue.Empty() &&
-                   update->EventTimestamp >= m_input_order_queue.Front()->CreateTimestamp + m_executionLatency)
+                   timestamp >= m_input_order_queue.Front()->CreateTimestamp + m_executionLatency)
             {
                 auto &order = m_input_order_queue.Front();
-                m_order_exection_manager[order->Instrument].AddNewOrder(order);
-                m_output_new_orders_queue.PushBack(order);
+                executionManager(order->Instrument).AddNewOrder(order, displayedQty(order->Instrument, order->OrderSide, order->Price));
+                push(m_output_new_orders_queue, order);
                 m_input_order_queue.PopFront();
             }
 
             while (!m_input_order_cancel_queue.Empty() &&
-                   update->EventTimestamp >= m_input_order_cancel_queue.Front()->CreateTimestamp + m_executionLatency)
+                   timestamp >= m_input_order_cancel_queue.Front()->CreateTimestamp + m_executionLatency)
             {
                 auto &order = m_input_order_cancel_queue.Front();
                 if (order->State != OrderState::Filled)
                 {
-                    m_order_exection_manager[order->Instrument].CancelOrder(order);
+                    executionManager(order->Instrument).CancelOrder(order);
                 }
-                m_output_canceled_orders_queue.PushBack(order);
+                push(m_output_canceled_orders_queue, order);
                 m_input_order_cancel_queue.PopFront();
             }
 
             while (!m_input_replaced_orders_queue.Empty() &&
-                   update->EventTimestamp >= std::get<3>(m_input_replaced_orders_queue.Front()) + m_executionLatency)
+                   timestamp >= std::get<3>(m_input_replaced_orders_queue.Front()) + m_executionLatency)
             {
-                auto &record = m_input_replaced_orders_queue.Front();
-                if (std::get<0>(record)->State != OrderState::Active)
+                auto &[order, price, qty, timestamp] = m_input_replaced_orders_queue.Front();
+                if ((order->State == OrderState::Active || order->State == OrderState::PartiallyFilled) &&
+                    executionManager(order->Instrument).ReplaceOrder(order, price, qty, displayedQty(order->Instrument, order->OrderSide, price)))
                 {
-                    m_input_replaced_orders_queue.PopFront();
-                    continue;
+                    push(m_output_replaced_orders_queue, std::make_tuple(order, timestamp));
+                    ++order->PendingReplaces;
                 }
-                m_order_exection_manager[std::get<0>(record)->Instrument].ReplaceOrder(std::get<0>(record), std::get<1>(record), std::get<2>(record));
-                m_output_replaced_orders_queue.PushBack(std::make_tuple(std::get<0>(record), std::get<3>(record)));
                 m_input_replaced_orders_queue.PopFront();
             }
         }
 
-        void processOutputQueues(MarketDataUpdatePtr update)
+        void processOutputQueues(Timestamp timestamp)
         {
             while (!m_output_new_orders_queue.Empty() &&
-                   update->EventTimestamp >= m_output_new_orders_queue.Front()->CreateTimestamp + m_executionLatency)
+                   timestamp >= m_output_new_orders_queue.Front()->CreateTimestamp + m_executionLatency)
             {
                 auto &order = m_output_new_orders_queue.Front();
                 order->LastReportTimestamp = m_currentTimestamp;
                 m_output_new_orders_queue.Front()->State = OrderState::Active;
+                record(JournalEvent::New, order);
                 m_new_order_callback(m_output_new_orders_queue.Front());
                 m_output_new_orders_queue.PopFront();
             }
 
             while (!m_output_canceled_orders_queue.Empty() &&
-                   update->EventTimestamp >= m_output_canceled_orders_queue.Front()->CreateTimestamp + 2 * m_executionLatency)
+                   timestamp >= m_output_canceled_orders_queue.Front()->CreateTimestamp + 2 * m_executionLatency)
             {
                 auto &order = m_output_canceled_orders_queue.Front();
                 if (order->State != OrderState::Filled)
                 {
                     order->LastReportTimestamp = m_currentTimestamp;
                     order->State = OrderState::Canceled;
+                    record(JournalEvent::Canceled, order);
                     m_canceled_order_callback(order);
                 }
                 m_output_canceled_orders_queue.PopFront();
             }
 
             while (!m_output_replaced_orders_queue.Empty() &&
-                   update->EventTimestamp >= std::get<1>(m_output_replaced_orders_queue.Front()) + 2 * m_executionLatency)
+                   timestamp >= std::get<1>(m_output_replaced_orders_queue.Front()) + 2 * m_executionLatency)
             {
                 auto &order = std::get<0>(m_output_replaced_orders_queue.Front());
-                if (order->State != OrderState::Active)
+                --order->PendingReplaces;
+                if (order->State == OrderState::Active || order->State == OrderState::PartiallyFilled)
                 {
-                    continue;
-                    m_output_replaced_orders_queue.PopFront();
+                    order->LastReportTimestamp = m_currentTimestamp;
+                    record(JournalEvent::Replaced, order);
+                    m_replaced_order_callback(order);
                 }
-                order->LastReportTimestamp = m_currentTimestamp;
-                order->State = OrderState::Active;
-                m_replaced_order_callback(order);
                 m_output_replaced_orders_queue.PopFront();
             }
 
+            // Fills of an amended order follow the acknowledgement of the amend, they are held
+            // aside meanwhile and fills of other orders go on
+            for (size_t i = 0; i < m_heldFills.size();)
+            {
+                if (m_heldFills[i].Order->PendingReplaces == 0)
+                {
+                    reportFill(m_heldFills[i]);
+                    m_heldFills.erase(m_heldFills.begin() + i);
+                }
+                else
+                    ++i;
+            }
+
             while (!m_output_executed_orders_queue.Empty() &&
-                   update->EventTimestamp >= m_output_executed_orders_queue.Front()->CreateTimestamp + 2 * m_executionLatency)
+                   timestamp >= m_output_executed_orders_queue.Front().Order->CreateTimestamp + 2 * m_executionLatency)
             {
-                auto &order = m_output_executed_orders_queue.Front();
-                order->LastReportTimestamp = m_currentTimestamp;
-                order->State = OrderState::Filled;
-                m_executed_order_callback(order);
+                auto &fill = m_output_executed_orders_queue.Front();
+                if (fill.Order->PendingReplaces != 0)
+                    m_heldFills.push_back(fill);
+                else
+                    reportFill(fill);
                 m_output_executed_orders_queue.PopFront();
             }
 
             while (!m_output_md_trades_queue.Empty() &&
-                   update->EventTimestamp >= m_output_md_trades_queue.Front()->LocalTimestamp)
+                   timestamp >= m_output_md_trades_queue.Front()->LocalTimestamp)
             {
-                m_md_trade_callback(m_output_md_trades_queue.Front());
+                if (m_md_batch_callback)
+                    deliver(m_output_md_trades_queue.Front());
+                else
+                    m_md_trade_callback(m_output_md_trades_queue.Front());
                 m_output_md_trades_queue.PopFront();
             }
 
+            while (!m_output_md_columnar_trades_queue.Empty())
+            {
+                auto [columns, n] = m_output_md_columnar_trades_queue.Front();
+                if (timestamp < columns->EventTimestamps[n] + m_marketDataLatency)
+                    break;
+                MDTrade &trade = m_md_batch_callback ? m_materialized.emplace_back() : m_trade;
+                columns->Materialize(n, trade);
+                trade.LocalTimestamp = trade.EventTimestamp + m_marketDataLatency;
+                if (m_md_batch_callback)
+                    deliver(&trade);
+                else
+                    m_md_trade_callback(&trade);
+                m_output_md_columnar_trades_queue.PopFront();
+            }
+
             while (!m_output_md_l1_updates_queue.Empty() &&
-                   update->EventTimestamp >= m_output_md_l1_updates_queue.Front()->LocalTimestamp)
+                   timestamp >= m_output_md_l1_updates_queue.Front()->LocalTimestamp)
             {
-                m_md_l1_callback(m_output_md_l1_updates_queue.Front());
+                if (m_md_batch_callback)
+                    deliver(m_output_md_l1_updates_queue.Front());
+                else
+                    m_md_l1_callback(m_output_md_l1_updates_queue.Front());
                 m_output_md_l1_updates_queue.PopFront();
             }
 
+            while (!m_output_md_l2_updates_queue.Empty() &&
+                   timestamp >= m_output_md_l2_updates_queue.Front()->LocalTimestamp)
+            {
+                if (m_md_batch_callback)
+                    deliver(m_output_md_l2_updates_queue.Front());
+                else if (m_md_l2_callback)
+                    m_md_l2_callback(m_output_md_l2_updates_queue.Front());
+                m_output_md_l2_updates_queue.PopFront();
+            }
+
             while (!m_output_md_custom_updates_queue.Empty() &&
-                   update->EventTimestamp >= m_output_md_custom_updates_queue.Front()->EventTimestamp + m_marketDataLatency)
+                   timestamp >= m_output_md_custom_updates_queue.Front()->EventTimestamp + m_marketDataLatency)
             {
-                m_md_custom_update_callback(m_output_md_custom_updates_queue.Front());
+                if (m_md_batch_callback)
+                    deliver(m_output_md_custom_updates_queue.Front());
+                else
+                    m_md_custom_update_callback(m_output_md_custom_updates_queue.Front());
                 m_output_md_custom_updates_queue.PopFront();
             }
 
             while (!m_output_md_custom_multiple_updates_queue.Empty() &&
-                   update->EventTimestamp >= m_output_md_custom_multiple_updates_queue.Front()->EventTimestamp + m_marketDataLatency)
+                   timestamp >= m_output_md_custom_multiple_updates_queue.Front()->EventTimestamp + m_marketDataLatency)
             {
-                m_md_custom_multiple_update_callback(m_output_md_custom_multiple_updates_queue.Front());
+                if (m_md_batch_callback)
+                    deliver(m_output_md_custom_multiple_updates_queue.Front());
+                else
+                    m_md_custom_multiple_update_callback(m_output_md_custom_multiple_updates_queue.Front());
                 m_output_md_custom_multiple_updates_queue.PopFront();
             }
         }
@@ -269,15 +524,20 @@ namespace CRPT::Core
         CircularBuffer<OrderPtr, QueueSize> m_input_order_cancel_queue;
         CircularBuffer<std::tuple<OrderPtr, double, double, Timestamp>, QueueSize> m_input_replaced_orders_queue;
         CircularBuffer<OrderPtr, QueueSize> m_output_new_orders_queue;
-        CircularBuffer<OrderPtr, QueueSize> m_output_executed_orders_queue;
+        CircularBuffer<OrderFill, QueueSize> m_output_executed_orders_queue;
         CircularBuffer<OrderPtr, QueueSize> m_output_canceled_orders_queue;
         CircularBuffer<std::tuple<OrderPtr, Timestamp>, QueueSize> m_output_replaced_orders_queue;
         CircularBuffer<MDTradePtr, QueueSize> m_output_md_trades_queue;
+        CircularBuffer<std::pair<const MDTradeColumns *, size_t>, QueueSize> m_output_md_columnar_trades_queue;
         CircularBuffer<MDCustomUpdatePtr, QueueSize> m_output_md_custom_updates_queue;
         CircularBuffer<MDCustomMultipleUpdatePtr, QueueSize> m_output_md_custom_multiple_updates_queue;
         CircularBuffer<MDL1UpdatePtr, QueueSize> m_output_md_l1_updates_queue;
+        CircularBuffer<MDL2UpdatePtr, QueueSize> m_output_md_l2_updates_queue;
 
         std::unordered_map<std::string, OrderExecutionManager> m_order_exection_manager;
+        std::unordered_map<std::string, L2Book> m_l2_books;
+        // Bid price, bid qty, ask price and ask qty of the latest L1 update per instrument
+        std::unordered_map<std::string, std::tuple<double, double, double, double>> m_tops;
 
         std::function<void(OrderPtr)> m_executed_order_callback;
         std::function<void(OrderPtr)> m_canceled_order_callback;
@@ -285,8 +545,21 @@ namespace CRPT::Core
         std::function<void(OrderPtr)> m_new_order_callback;
         std::function<void(MDTradePtr)> m_md_trade_callback;
         std::function<void(MDL1UpdatePtr)> m_md_l1_callback;
+        std::function<void(MDL2UpdatePtr)> m_md_l2_callback;
         std::function<void(MDCustomUpdatePtr)> m_md_custom_update_callback;
         std::function<void(MDCustomMultipleUpdatePtr)> m_md_custom_multiple_update_callback;
+        std::function<void(std::span<const MarketDataUpdatePtr>)> m_md_batch_callback;
+        std::vector<MarketDataUpdatePtr> m_delivered;
+        // Columnar trades passed to the callbacks, the trade callback gets m_trade for the
+        // duration of the call and the batch callback the trades of m_materialized
+        MDTrade m_trade;
+        std::deque<MDTrade> m_materialized;
+        Journal *m_journal{nullptr};
+        std::vector<OrderFill> m_fills;
+        std::vector<OrderFill> m_heldFills;
+        bool m_partialFills{false};
+        bool m_queuePositions{false};
+        bool m_throwOnQueueOverflow{false};
 
         Timedelta m_executionLatency{0}, m_marketDataLatency{0};
         Timestamp m_currentTimestamp{0}, m_nextTimestamp{0};
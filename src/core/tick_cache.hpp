@@ -0,0 +1,167 @@
+#pragma once
+
+#include "tick_store.hpp"
+#include "../utils/helpers.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Core
+{
+    // Directory of tick files caching query results, keyed by a hash of the normalized query
+    // and the identity of the server it ran on. Loads refresh the mtime of an entry and
+    // stores evict the least recently used entries beyond maxBytes (0 for no limit).
+    class TickFileCache
+    {
+    public:
+        static constexpr const char *EXTENSION = ".tick";
+
+        TickFileCache(const std::string &directory, u_int64_t maxBytes = 0) : m_directory(directory),
+                                                                            m_maxBytes(maxBytes)
+        {
+            std::filesystem::create_directories(m_directory);
+        }
+
+        // Collapses whitespace outside of quotes and drops a trailing semicolon, so that
+        // reformatted queries share their entry
+        static std::string NormalizeQuery(std::string_view query)
+        {
+            std::string result;
+            char quote = 0;
+            bool space = false;
+            for (size_t i = 0; i < query.size(); ++i)
+            {
+                char c = query[i];
+                if (quote == 0 && std::isspace((unsigned char)c))
+                {
+                    space = true;
+                    continue;
+                }
+                if (space && !result.empty())
+                    result.push_back(' ');
+                space = false;
+                result.push_back(c);
+
+                if (quote != 0 && c == '\\' && i + 1 < query.size())
+                    result.push_back(query[++i]);
+                else if (quote == 0 && (c == '\'' || c == '"' || c == '`'))
+                    quote = c;
+                else if (c == quote)
+                    quote = 0;
+            }
+            while (!result.empty() && (result.back() == ';' || result.back() == ' '))
+                result.pop_back();
+            return result;
+        }
+
+        static std::string Key(const std::string &server, const std::string &query)
+        {
+            return Utils::Helpers::ToHex(Utils::Helpers::Hash(NormalizeQuery(query), Utils::Helpers::Hash(server + "\n")));
+        }
+
+        // Appends the cached result to out, false on a miss
+        template <class T>
+        bool Load(const std::string &key, std::vector<T> &out) const
+        {
+            std::string path = Path(key);
+            std::error_code ec;
+            if (!std::filesystem::exists(path, ec))
+                return false;
+
+            size_t size = out.size();
+            try
+            {
+                TickStore::Read(path, out);
+            }
+            catch (const std::runtime_error &)
+            {
+                out.resize(size);
+                return false;
+            }
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+            return true;
+        }
+
+        // Stores data under key, false if it could not be written. A failed store leaves
+        // the cache as it was, so callers can carry on with the data they have.
+        template <class T>
+        bool Store(const std::string &key, const std::vector<T> &data) const
+        {
+            std::string path = Path(key);
+            std::string tmpPath = path + "." + Utils::Helpers::GetUniqueSuffix() + ".tmp";
+            try
+            {
+                TickStore::Write(tmpPath, data);
+                std::filesystem::rename(tmpPath, path);
+            }
+            catch (const std::exception &)
+            {
+                std::error_code ec;
+                std::filesystem::remove(tmpPath, ec);
+                return false;
+            }
+            evict(path);
+            return true;
+        }
+
+        void Invalidate(const std::string &key) const
+        {
+            std::error_code ec;
+            std::filesystem::remove(Path(key), ec);
+        }
+
+        void Clear() const
+        {
+            for (auto &[time, size, path] : entries())
+                Invalidate(path.stem());
+        }
+
+        // Total size of the entries in bytes
+        u_int64_t Size() const
+        {
+            u_int64_t total = 0;
+            for (auto &[time, size, path] : entries())
+                total += size;
+            return total;
+        }
+
+        std::string Path(const std::string &key) const
+        {
+            return (m_directory / (key + EXTENSION)).string();
+        }
+
+    private:
+        std::vector<std::tuple<std::filesystem::file_time_type, u_int64_t, std::filesystem::path>> entries() const
+        {
+            std::vector<std::tuple<std::filesystem::file_time_type, u_int64_t, std::filesystem::path>> result;
+            std::error_code ec;
+            for (auto &entry : std::filesystem::directory_iterator(m_directory, ec))
+                if (entry.is_regular_file(ec) && entry.path().extension() == EXTENSION)
+                    result.emplace_back(entry.last_write_time(ec), entry.file_size(ec), entry.path());
+            return result;
+        }
+
+        // Removes the least recently used entries until the cache fits, keeping the newest one
+        void evict(const std::string &keep) const
+        {
+            if (m_maxBytes == 0)
+                return;
+            auto all = entries();
+            std::sort(all.begin(), all.end());
+            u_int64_t total = 0;
+            for (auto &[time, size, path] : all)
+                total += size;
+            std::error_code ec;
+            for (auto &[time, size, path] : all)
+            {
+                if (total <= m_maxBytes)
+                    break;
+                if (path == keep)
+                    continue;
+                std::filesystem::remove(path, ec);
+                total -= size;
+            }
+        }
+
+        std::filesystem::path m_directory;
+        u_int64_t m_maxBytes;
+    };
+}
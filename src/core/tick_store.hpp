@@ -0,0 +1,299 @@
+#pragma once
+
+#include "entity.hpp"
+#include "market_data_source.hpp"
+#include "../utils/mapped_file.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Core
+{
+    // Fixed-layout binary tick files.
+    // Layout: TickFileHeader, instrument table (u_int32_t length + bytes per name),
+    // then RecordCount records starting at RecordsOffset (8-byte aligned).
+    namespace TickStore
+    {
+        constexpr char MAGIC[8] = {'C', 'R', 'P', 'T', 'T', 'C', 'K', '1'};
+        constexpr u_int32_t VERSION = 1;
+
+        struct TickFileHeader
+        {
+            char Magic[8];
+            u_int32_t Version;
+            u_int32_t DataType;
+            u_int64_t RecordCount;
+            u_int64_t InstrumentCount;
+            u_int64_t RecordsOffset;
+        };
+
+        struct TradeRecord
+        {
+            UpdateId Id;
+            Timestamp EventTimestamp;
+            Timestamp LocalTimestamp;
+            double Price;
+            double Qty;
+            u_int32_t Instrument;
+            Side AggressorSide;
+        };
+
+        struct L1Record
+        {
+            UpdateId Id;
+            Timestamp EventTimestamp;
+            Timestamp LocalTimestamp;
+            double AskPrice;
+            double BidPrice;
+            double AskQty;
+            double BidQty;
+            double Qty;
+            u_int32_t Instrument;
+        };
+
+        template <class T>
+        struct Traits;
+
+        template <>
+        struct Traits<MDTrade>
+        {
+            using Record = TradeRecord;
+            static constexpr MarketDataType Type = MarketDataType::Trade;
+
+            static void Encode(const MDTrade &trade, u_int32_t instrument, Record &record)
+            {
+                record.Id = trade.Id;
+                record.EventTimestamp = trade.EventTimestamp;
+                record.LocalTimestamp = trade.LocalTimestamp;
+                record.Price = trade.Price;
+                record.Qty = trade.Qty;
+                record.Instrument = instrument;
+                record.AggressorSide = trade.AggressorSide;
+            }
+
+            static void Decode(const Record &record, const std::string &instrument, MDTrade &trade)
+            {
+                trade.Id = record.Id;
+                trade.EventTimestamp = record.EventTimestamp;
+                trade.LocalTimestamp = record.LocalTimestamp;
+                trade.Price = record.Price;
+                trade.Qty = record.Qty;
+                trade.AggressorSide = record.AggressorSide;
+                trade.Instrument = instrument;
+            }
+        };
+
+        template <>
+        struct Traits<MDL1Update>
+        {
+            using Record = L1Record;
+            static constexpr MarketDataType Type = MarketDataType::L1Update;
+
+            static void Encode(const MDL1Update &update, u_int32_t instrument, Record &record)
+            {
+                record.Id = update.Id;
+                record.EventTimestamp = update.EventTimestamp;
+                record.LocalTimestamp = update.LocalTimestamp;
+                record.AskPrice = update.AskPrice;
+                record.BidPrice = update.BidPrice;
+                record.AskQty = update.AskQty;
+                record.BidQty = update.BidQty;
+                record.Qty = update.Qty;
+                record.Instrument = instrument;
+            }
+
+            static void Decode(const Record &record, const std::string &instrument, MDL1Update &update)
+            {
+                update.Id = record.Id;
+                update.EventTimestamp = record.EventTimestamp;
+                update.LocalTimestamp = record.LocalTimestamp;
+                update.AskPrice = record.AskPrice;
+                update.BidPrice = record.BidPrice;
+                update.AskQty = record.AskQty;
+                update.BidQty = record.BidQty;
+                update.Qty = record.Qty;
+                update.Instrument = instrument;
+            }
+        };
+
+        template <class T>
+        void Write(const std::string &path, const std::vector<T> &data)
+        {
+            using Record = typename Traits<T>::Record;
+
+            std::vector<std::string> instruments;
+            std::unordered_map<std::string, u_int32_t> index;
+            std::vector<Record> records;
+            records.reserve(data.size());
+            for (auto &update : data)
+            {
+                auto [it, inserted] = index.try_emplace(update.Instrument, u_int32_t(instruments.size()));
+                if (inserted)
+                    instruments.push_back(update.Instrument);
+                // Zeroed first so the padding written to the file is deterministic
+                Record &record = records.emplace_back();
+                std::memset(&record, 0, sizeof(record));
+                Traits<T>::Encode(update, it->second, record);
+            }
+
+            u_int64_t offset = sizeof(TickFileHeader);
+            for (auto &instrument : instruments)
+                offset += sizeof(u_int32_t) + instrument.size();
+            u_int64_t padding = (8 - offset % 8) % 8;
+            offset += padding;
+
+            TickFileHeader header{};
+            std::memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+            header.Version = VERSION;
+            header.DataType = u_int32_t(Traits<T>::Type);
+            header.RecordCount = records.size();
+            header.InstrumentCount = instruments.size();
+            header.RecordsOffset = offset;
+
+            std::ofstream file{path, std::ios::binary};
+            if (!file)
+                throw std::runtime_error("Unable to open " + path);
+            file.write((const char *)&header, sizeof(header));
+            for (auto &instrument : instruments)
+            {
+                u_int32_t length = instrument.size();
+                file.write((const char *)&length, sizeof(length));
+                file.write(instrument.data(), length);
+            }
+            const char zeros[8] = {};
+            file.write(zeros, padding);
+            file.write((const char *)records.data(), records.size() * sizeof(Record));
+            if (!file)
+                throw std::runtime_error("Unable to write " + path);
+        }
+
+        // Read-only mapping of a tick file
+        class MappedTickFile
+        {
+        public:
+            MappedTickFile(const std::string &path) : m_file(path)
+            {
+                if (m_file.size() < sizeof(TickFileHeader))
+                    throw std::runtime_error(path + " is not a tick file");
+
+                std::memcpy(&m_header, m_file.data(), sizeof(m_header));
+                if (std::memcmp(m_header.Magic, MAGIC, sizeof(MAGIC)) != 0 || m_header.Version != VERSION)
+                    throw std::runtime_error(path + " is not a tick file");
+
+                size_t recordSize;
+                if (m_header.DataType == u_int32_t(MarketDataType::Trade))
+                    recordSize = sizeof(TradeRecord);
+                else if (m_header.DataType == u_int32_t(MarketDataType::L1Update))
+                    recordSize = sizeof(L1Record);
+                else
+                    throw std::runtime_error(path + " holds an unsupported data type");
+                const char *cursor = m_file.data() + sizeof(TickFileHeader);
+                const char *end = m_file.data() + m_file.size();
+                for (u_int64_t i = 0; i < m_header.InstrumentCount && cursor + sizeof(u_int32_t) <= end; ++i)
+                {
+                    u_int32_t length;
+                    std::memcpy(&length, cursor, sizeof(length));
+                    cursor += sizeof(length);
+                    if (cursor + length > end)
+                        break;
+                    m_instruments.emplace_back(cursor, length);
+                    cursor += length;
+                }
+                // Compared by division, a corrupted count can't overflow the bound
+                if (m_instruments.size() != m_header.InstrumentCount ||
+                    m_header.RecordsOffset < size_t(cursor - m_file.data()) || m_header.RecordsOffset > m_file.size() ||
+                    m_header.RecordCount > (m_file.size() - m_header.RecordsOffset) / recordSize)
+                    throw std::runtime_error(path + " is truncated");
+                if (m_header.RecordsOffset % alignof(TradeRecord) != 0 || m_header.RecordsOffset % alignof(L1Record) != 0)
+                    throw std::runtime_error(path + " has misaligned records");
+            }
+
+            MarketDataType GetDataType() const
+            {
+                return MarketDataType(m_header.DataType);
+            }
+
+            size_t size() const
+            {
+                return m_header.RecordCount;
+            }
+
+            template <class Record>
+            const Record *Records() const
+            {
+                return (const Record *)(m_file.data() + m_header.RecordsOffset);
+            }
+
+            const std::vector<std::string> &GetInstruments() const
+            {
+                return m_instruments;
+            }
+
+        private:
+            Utils::MappedFile m_file;
+            TickFileHeader m_header;
+            std::vector<std::string> m_instruments;
+        };
+
+        using MappedTickFilePtr = std::shared_ptr<MappedTickFile>;
+
+        // Decodes records straight from the mapping into the row chunks
+        template <class T>
+        class MappedTickSource : public IMDRowSource<T>
+        {
+            using Record = typename Traits<T>::Record;
+
+        public:
+            MappedTickSource(MappedTickFilePtr file) : m_file(file)
+            {
+                if (file->GetDataType() != Traits<T>::Type)
+                    throw std::runtime_error("Tick file holds " + ToString(file->GetDataType()) + " records");
+            }
+
+            size_t Read(std::vector<T> &chunk, size_t maxSize) override
+            {
+                size_t count = std::min(maxSize, m_file->size() - m_position);
+                const Record *records = m_file->Records<Record>() + m_position;
+                auto &instruments = m_file->GetInstruments();
+                size_t first = chunk.size();
+                chunk.resize(first + count);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (records[i].Instrument >= instruments.size())
+                    {
+                        chunk.resize(first + i);
+                        throw std::runtime_error("Tick file record refers to unknown instrument " + std::to_string(records[i].Instrument));
+                    }
+                    Traits<T>::Decode(records[i], instruments[records[i].Instrument], chunk[first + i]);
+                }
+                m_position += count;
+                return count;
+            }
+
+            void Rewind() override
+            {
+                m_position = 0;
+            }
+
+            // Records have a fixed size, so they are binary searched in place
+            std::optional<size_t> Seek(Timestamp timestamp) override
+            {
+                const Record *records = m_file->Records<Record>();
+                m_position = std::partition_point(records, records + m_file->size(), [timestamp](const Record &record)
+                                                  { return record.EventTimestamp < timestamp; }) -
+                             records;
+                return m_position;
+            }
+
+        private:
+            MappedTickFilePtr m_file;
+            size_t m_position{0};
+        };
+
+        // Appends all the records of a tick file to out
+        template <class T>
+        void Read(const std::string &path, std::vector<T> &out)
+        {
+            auto file = std::make_shared<MappedTickFile>(path);
+            MappedTickSource<T>(file).Read(out, file->size());
+        }
+    }
+}
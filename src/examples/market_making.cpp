@@ -20,8 +20,8 @@ public:
                      [this](MDCustomMultipleUpdatePtr update) { this->OnMDCustomMultipleUpdate(update); }
                      )
     {
-        readCSV(ttf_midprices, m_ttf_midprices, "ttf");
-        readCSV(the_midprices, m_the_midprices, "the");
+        m_ttf_midprices = std::move(CSVMarketDataCustomMultipleManager({ttf_midprices}, "ttf", {"midprice", "spread"}).GetUpdates());
+        m_the_midprices = std::move(CSVMarketDataCustomMultipleManager({the_midprices}, "the", {"midprice", "spread"}).GetUpdates());
         readCSV(the_trades, m_the_trades);
     }
     
@@ -79,11 +79,13 @@ public:
 
     void ReplaceQuotes()
     {
-        RemoveQuotes();
         if (Offset == 0)
+        {
+            RemoveQuotes();
             return;
-        bid_order = sendOrder("THE", last_ref_price + Offset - last_ref_price*Spread/2, 5, Side::Buy, OrderType::Limit);
-        ask_order = sendOrder("THE", last_ref_price + Offset + last_ref_price*Spread/2, 5, Side::Sell, OrderType::Limit);
+        }
+        bid_order = quote(bid_order, last_ref_price + Offset - last_ref_price*Spread/2, 5, Side::Buy);
+        ask_order = quote(ask_order, last_ref_price + Offset + last_ref_price*Spread/2, 5, Side::Sell);
     }
 
     void Run()
@@ -99,35 +101,21 @@ public:
 
 
 private:
-    void readCSV(std::string path, std::vector<MDCustomMultipleUpdate>& out, std::string text = "")
-    {
-        auto buffer = Helpers::ReadCSV(path, ',');
-        for (int i = 1; i < buffer.size(); ++i)
-        {
-            MDCustomMultipleUpdate update;
-            update.Text = text;
-            update.EventTimestamp = std::stol(buffer[i][0]);
-            update.Payload["midprice"] = std::stod(buffer[i][1]);
-            update.Payload["spread"] = std::stod(buffer[i][2]);
-            out.push_back(update);
-        }
-    }  
-
     void readCSV(std::string path, std::vector<MDTrade>& out)
     {
-        auto buffer = Helpers::ReadCSV(path, ',');
-        for (int i = 1; i < buffer.size(); ++i)
+        static const CSVSchema<MDTrade> schema = CSVSchema<MDTrade>()
+            .Column(0, [](std::string_view field, MDTrade &trade) { trade.EventTimestamp = CSVField::ToUInt64(field); })
+            .Column(1, [](std::string_view field, MDTrade &trade) { trade.Price = CSVField::ToDouble(field); })
+            .Column(2, [](std::string_view field, MDTrade &trade) { trade.Qty = CSVField::ToDouble(field); });
+        CSVMarketDataManager<MDTrade> trades({path}, schema, 0, 1);
+        out.reserve(2 * trades.GetData().size());
+        for (auto &trade : trades)
         {
-            MDTrade trade_buy;
-            trade_buy.AggressorSide = Side::Buy;
-            trade_buy.EventTimestamp = std::stol(buffer[i][0]);
-            trade_buy.Price = std::stod(buffer[i][1]);
-            trade_buy.Qty = std::stod(buffer[i][2]);
-            trade_buy.Instrument = "THE";
-            MDTrade trade_sell = trade_buy;
-            trade_sell.AggressorSide = Side::Sell;
-            m_the_trades.push_back(trade_buy);
-            m_the_trades.push_back(trade_sell);
+            trade.Instrument = "THE";
+            trade.AggressorSide = Side::Buy;
+            out.push_back(trade);
+            trade.AggressorSide = Side::Sell;
+            out.push_back(trade);
         }
     }
 
@@ -148,6 +136,19 @@ private:
         return &orders[order_coursor++];
     }
 
+    // Amends a live quote in place, anything else is replaced by a new order
+    OrderPtr quote(OrderPtr order, double price, double qty, Side side)
+    {
+        if (order != nullptr && order->State == OrderState::Active)
+        {
+            m_simulation.OnOrderReplace(order, price, qty);
+            return order;
+        }
+        if (order != nullptr)
+            cancelOrder(order);
+        return sendOrder("THE", price, qty, side, OrderType::Limit);
+    }
+
     OrderPtr cancelOrder(OrderPtr order)
     {
         m_simulation.OnCancelOrder(order);
@@ -0,0 +1,58 @@
+#include "../core/market_data_simulation_manager.hpp"
+
+#include <iostream>
+#include <random>
+
+using namespace CRPT::Core;
+
+// Measures MarketDataSimulationManager iteration over many interleaved rows
+// for a set of prefetch distances
+int main(int argc, char *argv[])
+{
+    size_t nRows = argc > 1 ? std::stoul(argv[1]) : 256;
+    size_t rowSize = argc > 2 ? std::stoul(argv[2]) : 100000;
+
+    std::mt19937_64 rng(42);
+    std::vector<std::vector<MDTrade>> rows(nRows);
+    for (auto &row : rows)
+    {
+        row.resize(rowSize);
+        Timestamp ts = 0;
+        for (auto &trade : row)
+        {
+            ts += rng() % 1000;
+            trade.EventTimestamp = ts;
+            trade.Price = 100;
+            trade.Qty = 1;
+        }
+    }
+
+    MarketDataSimulationManager manager;
+    for (auto &row : rows)
+        manager.AddRow(MDRow{row});
+
+    auto run = [&]()
+    {
+        double checksum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (auto iter = manager.begin(); iter != manager.end(); ++iter)
+            checksum += MDTradePtr(*iter)->Price;
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::make_pair(std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count(), checksum);
+    };
+
+    std::cout << nRows << " rows x " << rowSize << " trades\n";
+    for (bool compiled : {false, true})
+    {
+        if (compiled)
+            manager.CompileOrder();
+        for (size_t distance : {0, 1, 2, 4, 8, 16})
+        {
+            manager.SetPrefetchDistance(distance);
+            auto [ms, checksum] = run();
+            std::cout << (compiled ? "compiled order" : "heap merge") << ", prefetch distance " << distance
+                      << ": " << ms << " ms (checksum " << checksum << ")\n";
+        }
+    }
+    return 0;
+}
@@ -21,29 +21,21 @@ public:
                      ),
         orders(500000, Order())
     {
+        m_simulation.SetJournal(&m_journal);
     }
     
     void OnOrderCanceled(OrderPtr order){}
 
     void OnOrderReplaced(OrderPtr order){}
 
-    void OnNewOrder(OrderPtr order)
-    {
-        std::cout << Helpers::TimestampToStr(order->CreateTimestamp) 
-            << ';' << Helpers::TimestampToStr(m_simulation.GetCurrentTimestamp()) << '\n';
-    }
+    void OnNewOrder(OrderPtr order){}
 
     void OnMDCustomUpdate(MDCustomUpdatePtr update){}
 
     void OnL1Update(MDL1UpdatePtr update){}
 
-    void OnOrderFilled(OrderPtr order)
-    {
-        std::cout << "Order filled: " << Helpers::TimestampToStr(order->CreateTimestamp) << ';' << Helpers::TimestampToStr(order->LastReportTimestamp)
-            << ',' << order->LastExecPrice
-            << '\n';
-
-    }
+    // New orders and fills are recorded by the journal off the simulation thread
+    void OnOrderFilled(OrderPtr order){}
 
     void SendQuotes(int n_quotes, double price, double step)
     {
@@ -87,6 +79,12 @@ public:
         m_md_manager.Clear();
     }
 
+    void SaveOrders(const std::string &path)
+    {
+        m_journal.Close();
+        JournalReader(JOURNAL_PATH).ToCSV(path, ';');
+    }
+
 private:
     OrderPtr sendOrder(const std::string &instrument,
                    double price, 
@@ -112,6 +110,9 @@ private:
     }
 
 private:
+    static constexpr const char *JOURNAL_PATH = "pnd_quoter.jrn";
+
+    Journal m_journal{JOURNAL_PATH};
     MarketDataSimulationManager m_md_manager;
     Simulation<1000000> m_simulation;
     std::vector<Order> orders;
@@ -130,14 +131,10 @@ int main()
         "localhost", 19000, 
         "default", "root",
         "SELECT * FROM binance_futures_um_trades WHERE event_timestamp > '2025-02-14 02:04:26' and event_timestamp < '2025-02-14 02:24:26' and symbol == 'THEUSDT'");
-    std::sort(data.begin(), data.end(), 
-        [](MDTrade& trade_a, MDTrade& trade_b)
-        {
-            return trade_a.EventTimestamp < trade_b.EventTimestamp 
-                || (trade_a.EventTimestamp == trade_b.EventTimestamp && trade_a.Id < trade_b.Id);
-        });
+    MarketDataSorter::Sort(data);
     std::cout << Helpers::TimestampToStr(data[0].EventTimestamp) << "\nSTARTING ... \n";
     PnDQuoter strategy;
     strategy.Run(data, "RAREUSDT");
+    strategy.SaveOrders("pnd_quoter_orders.csv");
     return 0;
 }
\ No newline at end of file
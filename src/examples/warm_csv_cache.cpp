@@ -0,0 +1,48 @@
+#include "../core/market_data_simulation_manager.hpp"
+
+#include <iostream>
+
+using namespace CRPT::Core;
+
+// Writes the CSVCache sidecars of every .csv file under a directory, so that the
+// following backtests skip parsing
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <directory> [trades|quotes] [threads]\n";
+        return 1;
+    }
+    std::string directory = argv[1];
+    std::string type = argc > 2 ? argv[2] : "trades";
+    size_t threads = argc > 3 ? std::stoul(argv[3]) : 0;
+    if (type != "trades" && type != "quotes")
+    {
+        std::cerr << "Unknown data type " << type << "\n";
+        return 1;
+    }
+
+    int failed = 0;
+    for (auto &entry : std::filesystem::recursive_directory_iterator(directory))
+    {
+        if (!entry.is_regular_file() || entry.path().extension() != ".csv")
+            continue;
+
+        std::string path = entry.path();
+        auto start = std::chrono::high_resolution_clock::now();
+        try
+        {
+            size_t count = type == "trades" ? CSVMarketDataTradesManager({path}, threads, true).GetTrades().size()
+                                            : CSVMarketDataL1Manager({path}, threads, true).GetUpdates().size();
+            auto end = std::chrono::high_resolution_clock::now();
+            std::cout << path << ": " << count << " updates, "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms\n";
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << path << ": " << e.what() << "\n";
+            ++failed;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -37,9 +37,9 @@ namespace CRPT::Utils
                 m_end = -1;
             }
 
-            m_buffer[++m_end] = element;
-            if (m_end >= n)
+            if (++m_end >= n)
                 m_end = 0;
+            m_buffer[m_end] = element;
             ++m_size;
 
             return true;
@@ -55,9 +55,9 @@ namespace CRPT::Utils
                 m_end = 0;
             }
 
-            m_buffer[--m_begin] = element;
-            if (m_begin < 0)
+            if (--m_begin < 0)
                 m_begin = n - 1;
+            m_buffer[m_begin] = element;
             ++m_size;
 
             return true;
@@ -104,6 +104,11 @@ namespace CRPT::Utils
             return m_size == 0;
         }
 
+        bool Full() const
+        {
+            return m_size >= int(n);
+        }
+
     private:
         BufferType m_buffer;
         int m_begin{0}, m_end{-1};
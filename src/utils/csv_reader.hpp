@@ -0,0 +1,206 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Utils
+{
+    // Conversions of a single CSV field, without intermediate strings
+    namespace CSVField
+    {
+        inline u_int64_t ToUInt64(std::string_view field)
+        {
+            u_int64_t value = 0;
+            auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+            if (ec != std::errc() || ptr != field.data() + field.size())
+                throw std::runtime_error("Unable to parse '" + std::string(field) + "' as an integer");
+            return value;
+        }
+
+        inline double ToDouble(std::string_view field)
+        {
+            double value = 0;
+            auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+            if (ec != std::errc() || ptr != field.data() + field.size())
+                throw std::runtime_error("Unable to parse '" + std::string(field) + "' as a number");
+            return value;
+        }
+
+        // Case-insensitive comparison with a lowercase literal
+        inline bool IEquals(std::string_view field, std::string_view lower)
+        {
+            if (field.size() != lower.size())
+                return false;
+            for (size_t i = 0; i < field.size(); ++i)
+                if (std::tolower((unsigned char)field[i]) != lower[i])
+                    return false;
+            return true;
+        }
+    }
+
+    // Binds CSV columns to fields of T. Only bound columns are converted,
+    // the rest of the line past the last bound column isn't even scanned.
+    template <class T>
+    class CSVSchema
+    {
+    public:
+        using Parser = std::function<void(std::string_view, T &)>;
+
+        CSVSchema &Column(size_t index, Parser parser)
+        {
+            auto it = std::upper_bound(m_columns.begin(), m_columns.end(), index, [](size_t i, const auto &column)
+                                       { return i < column.first; });
+            m_columns.insert(it, {index, parser});
+            return *this;
+        }
+
+        // Parses a line without its terminator into record
+        void ParseLine(std::string_view line, char sep, T &record) const
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+
+            size_t index = 0, begin = 0;
+            for (auto &[column, parser] : m_columns)
+            {
+                for (; index < column; ++index)
+                {
+                    size_t next = line.find(sep, begin);
+                    if (next == std::string_view::npos)
+                        throw std::runtime_error("Line has no column " + std::to_string(column));
+                    begin = next + 1;
+                }
+                size_t end = line.find(sep, begin);
+                parser(line.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin), record);
+            }
+        }
+
+    private:
+        std::vector<std::pair<size_t, Parser>> m_columns;
+    };
+
+    // Schema-driven CSV reader working on a mapped file or any in-memory buffer
+    class CSVReader
+    {
+    public:
+        CSVReader(const std::string &path, char sep = ',') : m_file(std::make_shared<MappedFile>(path)),
+                                                             m_buffer(m_file->View()),
+                                                             m_origin(m_buffer.data()),
+                                                             m_sep(sep)
+        {
+        }
+
+        // Reader over a buffer owned by the caller
+        static CSVReader FromBuffer(std::string_view buffer, char sep = ',')
+        {
+            return CSVReader(nullptr, buffer, buffer.data(), sep);
+        }
+
+        // Appends a record per non-empty line to out, returns the number of records read.
+        // Parse errors report their line in the whole file or buffer, also for the readers
+        // of SkipLines and Split.
+        template <class T>
+        size_t Read(const CSVSchema<T> &schema, std::vector<T> &out, size_t skipLines = 0) const
+        {
+            size_t count = 0, lineNumber = 0;
+            const char *cursor = m_buffer.data();
+            const char *end = cursor + m_buffer.size();
+            while (cursor < end)
+            {
+                const char *eol = (const char *)std::memchr(cursor, '\n', end - cursor);
+                if (eol == nullptr)
+                    eol = end;
+                std::string_view line(cursor, eol - cursor);
+                cursor = eol + 1;
+
+                if (lineNumber++ < skipLines || line.empty() || line == "\r")
+                    continue;
+                out.emplace_back();
+                try
+                {
+                    schema.ParseLine(line, m_sep, out.back());
+                }
+                catch (const std::runtime_error &e)
+                {
+                    throw std::runtime_error(std::string(e.what()) + " at line " + std::to_string(lineAt(line.data())));
+                }
+                ++count;
+            }
+            return count;
+        }
+
+        // Reader over the buffer past the first lines
+        CSVReader SkipLines(size_t lines) const
+        {
+            size_t begin = 0;
+            for (; lines > 0 && begin < m_buffer.size(); --lines)
+            {
+                size_t eol = m_buffer.find('\n', begin);
+                begin = eol == std::string_view::npos ? m_buffer.size() : eol + 1;
+            }
+            return CSVReader(m_file, m_buffer.substr(begin), m_origin, m_sep);
+        }
+
+        // Fields of the first line
+        std::vector<std::string> Header() const
+        {
+            std::string_view line = m_buffer.substr(0, m_buffer.find('\n'));
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+
+            std::vector<std::string> fields;
+            size_t begin = 0;
+            while (true)
+            {
+                size_t end = line.find(m_sep, begin);
+                fields.emplace_back(line.substr(begin, end == std::string_view::npos ? std::string_view::npos : end - begin));
+                if (end == std::string_view::npos)
+                    break;
+                begin = end + 1;
+            }
+            return fields;
+        }
+
+        // Splits the buffer at line boundaries into readers over at most pieces
+        // consecutive parts; the parts share the mapping of this reader
+        std::vector<CSVReader> Split(size_t pieces) const
+        {
+            std::vector<CSVReader> readers;
+            size_t begin = 0, step = m_buffer.size() / std::max<size_t>(1, pieces) + 1;
+            while (begin < m_buffer.size())
+            {
+                size_t end = m_buffer.find('\n', std::min(begin + step, m_buffer.size()) - 1);
+                end = end == std::string_view::npos ? m_buffer.size() : end + 1;
+                readers.push_back(CSVReader(m_file, m_buffer.substr(begin, end - begin), m_origin, m_sep));
+                begin = end;
+            }
+            return readers;
+        }
+
+        std::string_view View() const
+        {
+            return m_buffer;
+        }
+
+    private:
+        CSVReader(std::shared_ptr<MappedFile> file, std::string_view buffer, const char *origin, char sep) : m_file(file),
+                                                                                                          m_buffer(buffer),
+                                                                                                          m_origin(origin),
+                                                                                                          m_sep(sep)
+        {
+        }
+
+        // 1-based line of position in the whole buffer, only counted on errors so splitting
+        // needs no pass over the lines
+        size_t lineAt(const char *position) const
+        {
+            return std::count(m_origin, position, '\n') + 1;
+        }
+
+        std::shared_ptr<MappedFile> m_file;
+        std::string_view m_buffer;
+        // Start of the whole file or buffer this reader is part of
+        const char *m_origin;
+        char m_sep;
+    };
+}
@@ -2,6 +2,10 @@
 
 #include "../definitions.h"
 
+#include <atomic>
+#include <random>
+#include <unistd.h>
+
 namespace CRPT::Utils
 {
     class Helpers
@@ -42,6 +46,30 @@ namespace CRPT::Utils
             return str;
         }
 
+        // Suffix unique to this process and call, for temporary files other processes may
+        // create next to ours
+        static std::string GetUniqueSuffix()
+        {
+            static const u_int64_t seed = (u_int64_t(std::random_device{}()) << 32) | std::random_device{}();
+            static std::atomic<u_int64_t> counter{0};
+            return std::to_string(::getpid()) + "." + ToHex(seed + counter++);
+        }
+
+        // 64-bit FNV-1a, stable across builds and platforms
+        static u_int64_t Hash(std::string_view data, u_int64_t hash = 14695981039346656037ull)
+        {
+            for (unsigned char c : data)
+                hash = (hash ^ c) * 1099511628211ull;
+            return hash;
+        }
+
+        static std::string ToHex(u_int64_t value)
+        {
+            char buf[17];
+            std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)value);
+            return std::string(buf, 16);
+        }
+
         static std::string ToLower(std::string str)
         {
             std::transform(str.begin(), str.end(), str.begin(), [](char c)
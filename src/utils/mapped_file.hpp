@@ -0,0 +1,69 @@
+#pragma once
+
+#include "../definitions.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace CRPT::Utils
+{
+    // Read-only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::string &path, int advice = MADV_SEQUENTIAL)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Unable to open " + path);
+            struct stat st{};
+            if (::fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("Unable to stat " + path);
+            }
+            m_size = st.st_size;
+            if (m_size == 0)
+            {
+                ::close(fd);
+                return;
+            }
+            void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+                throw std::runtime_error("Unable to map " + path);
+            m_data = (const char *)data;
+            ::madvise(data, m_size, advice);
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile()
+        {
+            if (m_data)
+                ::munmap((void *)m_data, m_size);
+        }
+
+        const char *data() const
+        {
+            return m_data;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        std::string_view View() const
+        {
+            return std::string_view(m_data, m_size);
+        }
+
+    private:
+        const char *m_data{nullptr};
+        size_t m_size{0};
+    };
+}
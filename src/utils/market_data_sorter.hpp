@@ -0,0 +1,164 @@
+#pragma once
+
+#include "parallel.hpp"
+#include "../definitions.h"
+
+namespace CRPT::Utils
+{
+    // Ingestion-stage sorter for market data vectors, ordered by (EventTimestamp, Id).
+    // The order is stable, updates with equal keys keep their input order.
+    class MarketDataSorter
+    {
+    public:
+        // Inputs made of at most this many ascending runs are merged instead of radix sorted
+        static constexpr size_t MAX_MERGED_RUNS = 64;
+
+        template <class T>
+        static void Sort(std::vector<T> &data, size_t threads = 0)
+        {
+            if (data.size() < 2)
+                return;
+
+            std::vector<size_t> runs = findRuns(data);
+            if (runs.size() == 2)
+                return;
+            if (runs.size() - 1 <= MAX_MERGED_RUNS)
+            {
+                mergeRuns(data, runs);
+                return;
+            }
+
+            if (threads == 0)
+                threads = DefaultThreadCount();
+            radixSort(data, threads);
+        }
+
+        template <class T>
+        static bool Less(const T &a, const T &b)
+        {
+            return a.EventTimestamp < b.EventTimestamp || (a.EventTimestamp == b.EventTimestamp && a.Id < b.Id);
+        }
+
+    private:
+        struct Key
+        {
+            u_int64_t EventTimestamp;
+            u_int64_t Id;
+            u_int64_t Index;
+        };
+
+        // Boundaries of the maximal ascending runs, {0, ..., data.size()}
+        template <class T>
+        static std::vector<size_t> findRuns(const std::vector<T> &data)
+        {
+            std::vector<size_t> runs{0};
+            for (size_t i = 1; i < data.size(); ++i)
+            {
+                if (Less(data[i], data[i - 1]))
+                {
+                    runs.push_back(i);
+                    if (runs.size() > MAX_MERGED_RUNS + 1)
+                        break;
+                }
+            }
+            runs.push_back(data.size());
+            return runs;
+        }
+
+        // Bottom-up pairwise merge of the runs, log2(runs) passes
+        template <class T>
+        static void mergeRuns(std::vector<T> &data, std::vector<size_t> runs)
+        {
+            std::vector<T> buffer(data.size());
+            while (runs.size() > 2)
+            {
+                std::vector<size_t> merged{0};
+                for (size_t i = 0; i + 1 < runs.size(); i += 2)
+                {
+                    auto first = std::make_move_iterator(data.begin() + runs[i]);
+                    auto middle = std::make_move_iterator(data.begin() + runs[i + 1]);
+                    if (i + 2 < runs.size())
+                    {
+                        auto last = std::make_move_iterator(data.begin() + runs[i + 2]);
+                        std::merge(first, middle, middle, last, buffer.begin() + runs[i], Less<T>);
+                        merged.push_back(runs[i + 2]);
+                    }
+                    else
+                    {
+                        std::copy(first, middle, buffer.begin() + runs[i]);
+                        merged.push_back(runs[i + 1]);
+                    }
+                }
+                data.swap(buffer);
+                runs = std::move(merged);
+            }
+        }
+
+        // LSD radix sort of (EventTimestamp, Id, index) keys by bytes, skipping bytes that are
+        // equal across all keys; the updates are then moved once into their final position
+        template <class T>
+        static void radixSort(std::vector<T> &data, size_t threads)
+        {
+            size_t n = data.size();
+            threads = std::min(threads, std::max<size_t>(1, n / 65536));
+            std::vector<Key> keys(n), buffer(n);
+            for (size_t i = 0; i < n; ++i)
+                keys[i] = {data[i].EventTimestamp, data[i].Id, i};
+
+            u_int64_t tsMask = 0, idMask = 0;
+            for (auto &key : keys)
+            {
+                tsMask |= key.EventTimestamp ^ keys[0].EventTimestamp;
+                idMask |= key.Id ^ keys[0].Id;
+            }
+
+            std::vector<std::pair<bool, int>> passes;
+            for (int byte = 0; byte < 8; ++byte)
+                if ((idMask >> (8 * byte)) & 0xff)
+                    passes.push_back({false, byte});
+            for (int byte = 0; byte < 8; ++byte)
+                if ((tsMask >> (8 * byte)) & 0xff)
+                    passes.push_back({true, byte});
+
+            size_t chunk = (n + threads - 1) / threads;
+            std::vector<std::array<size_t, 256>> counts(threads);
+            for (auto [timestamp, byte] : passes)
+            {
+                auto digit = [timestamp, byte](const Key &key)
+                {
+                    return ((timestamp ? key.EventTimestamp : key.Id) >> (8 * byte)) & 0xff;
+                };
+
+                ParallelFor(threads, threads, [&](size_t t)
+                            {
+                                counts[t].fill(0);
+                                for (size_t i = t * chunk; i < std::min(n, (t + 1) * chunk); ++i)
+                                    ++counts[t][digit(keys[i])];
+                            });
+
+                // Thread t writes digit d right after the same digit of threads before it
+                size_t offset = 0;
+                for (size_t d = 0; d < 256; ++d)
+                    for (size_t t = 0; t < threads; ++t)
+                    {
+                        size_t count = counts[t][d];
+                        counts[t][d] = offset;
+                        offset += count;
+                    }
+
+                ParallelFor(threads, threads, [&](size_t t)
+                            {
+                                for (size_t i = t * chunk; i < std::min(n, (t + 1) * chunk); ++i)
+                                    buffer[counts[t][digit(keys[i])]++] = keys[i];
+                            });
+                keys.swap(buffer);
+            }
+
+            std::vector<T> sorted;
+            sorted.reserve(n);
+            for (auto &key : keys)
+                sorted.push_back(std::move(data[key.Index]));
+            data.swap(sorted);
+        }
+    };
+}
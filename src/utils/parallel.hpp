@@ -0,0 +1,58 @@
+#pragma once
+
+#include "../definitions.h"
+
+#include <atomic>
+
+namespace CRPT::Utils
+{
+    inline size_t DefaultThreadCount()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Runs f(task) for every task in [0, tasks) on up to threads threads, the calling
+    // one included; tasks are handed out dynamically. The first exception is rethrown.
+    template <class F>
+    void ParallelFor(size_t threads, size_t tasks, F &&f)
+    {
+        threads = std::max<size_t>(1, std::min(threads, tasks));
+        if (threads == 1)
+        {
+            for (size_t task = 0; task < tasks; ++task)
+                f(task);
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+        auto worker = [&]()
+        {
+            for (size_t task = next++; task < tasks; task = next++)
+            {
+                try
+                {
+                    f(task);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                        error = std::current_exception();
+                    next = tasks;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for (size_t t = 1; t < threads; ++t)
+            workers.emplace_back(worker);
+        worker();
+        for (auto &thread : workers)
+            thread.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "../definitions.h"
+
+#include <atomic>
+
+namespace CRPT::Utils
+{
+    // Lock-free ring for exactly one producer thread and one consumer thread.
+    // The capacity is rounded up to a power of two.
+    template <class T>
+    class SPSCRing
+    {
+    public:
+        SPSCRing(size_t capacity)
+        {
+            size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            m_buffer.resize(size);
+            m_mask = size - 1;
+        }
+
+        SPSCRing(const SPSCRing &) = delete;
+
+        bool TryPush(const T &element)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_cachedHead > m_mask)
+            {
+                m_cachedHead = m_head.load(std::memory_order_acquire);
+                if (tail - m_cachedHead > m_mask)
+                    return false;
+            }
+            m_buffer[tail & m_mask] = element;
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Moves up to maxCount elements to out, returns their number
+        size_t PopBatch(T *out, size_t maxCount)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            size_t count = std::min(maxCount, m_tail.load(std::memory_order_acquire) - head);
+            for (size_t i = 0; i < count; ++i)
+                out[i] = m_buffer[(head + i) & m_mask];
+            m_head.store(head + count, std::memory_order_release);
+            return count;
+        }
+
+        bool Empty() const
+        {
+            return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+        }
+
+        size_t Capacity() const
+        {
+            return m_mask + 1;
+        }
+
+    private:
+        std::vector<T> m_buffer;
+        size_t m_mask;
+
+        // Producer and consumer positions on separate cache lines
+        alignas(64) std::atomic<size_t> m_head{0};
+        alignas(64) std::atomic<size_t> m_tail{0};
+        size_t m_cachedHead{0};
+    };
+}
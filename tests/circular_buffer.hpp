@@ -15,7 +15,9 @@ TEST(Utils, CircularBufferTest_PushPopBack)
     buffer.PushBack(2);
     buffer.PushBack(3);
     buffer.PushBack(4);
+    EXPECT_FALSE(buffer.Full());
     EXPECT_TRUE(buffer.PushBack(5));
+    EXPECT_TRUE(buffer.Full());
     EXPECT_FALSE(buffer.PushBack(6));
     EXPECT_EQ(buffer.Back(), 5);
     EXPECT_TRUE(buffer.PopBack());
@@ -90,4 +92,25 @@ TEST(Utils, CircularBufferTest_PushPopBackFront)
     EXPECT_EQ(buffer.Front(), 1);
     EXPECT_TRUE(buffer.PopFront());
     EXPECT_FALSE(buffer.PopFront());
-}
\ No newline at end of file
+}
+
+TEST(Utils, CircularBufferTest_Wraparound)
+{
+    CircularBuffer<int, 3> buffer;
+    for (int i = 0; i < 3; ++i)
+        EXPECT_TRUE(buffer.PushBack(i));
+    for (int i = 3; i < 10; ++i)
+    {
+        EXPECT_EQ(buffer.Front(), i - 3);
+        EXPECT_TRUE(buffer.PopFront());
+        EXPECT_TRUE(buffer.PushBack(i));
+        EXPECT_EQ(buffer.Back(), i);
+    }
+
+    CircularBuffer<int, 3> front;
+    for (int i = 0; i < 3; ++i)
+        EXPECT_TRUE(front.PushFront(i));
+    EXPECT_FALSE(front.PushFront(3));
+    EXPECT_EQ(front.Front(), 2);
+    EXPECT_EQ(front.Back(), 0);
+}
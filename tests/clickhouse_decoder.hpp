@@ -0,0 +1,108 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "../src/convenience/clickhouse.hpp"
+
+using namespace CRPT::Core;
+using namespace CRPT::Convenience;
+
+// Tests of the ClickHouse code that needs no server, the live server tests are in
+// clickhouse_fetcher.hpp
+
+TEST(ClickhouseBlockDecoderTest, DecodeRecordedBlocks)
+{
+    using namespace clickhouse;
+
+    auto id = std::make_shared<ColumnUInt64>();
+    auto symbol = std::make_shared<ColumnLowCardinalityT<ColumnString>>();
+    auto price = std::make_shared<ColumnFloat32>();
+    auto qty = std::make_shared<ColumnFloat64>();
+    auto side = std::make_shared<ColumnEnum8>(Type::CreateEnum8({{"BUY", 0}, {"SELL", 1}}));
+    auto ts = std::make_shared<ColumnDateTime64>(3);
+    for (int i = 0; i < 4; ++i)
+    {
+        id->Append(10 + i);
+        symbol->Append(i % 2 ? "ETHUSDT" : "BTCUSDT");
+        price->Append(100.5f + i);
+        qty->Append(0.25 * i);
+        side->Append(i % 2);
+        ts->Append(1700000000000 + i);
+    }
+    Block block;
+    block.AppendColumn("id", id);
+    block.AppendColumn("symbol", symbol);
+    block.AppendColumn("price", price);
+    block.AppendColumn("qty", qty);
+    block.AppendColumn("side", side);
+    block.AppendColumn("timestamp", ts);
+
+    std::vector<MDTrade> trades;
+    ClickhouseMarketDataFetcher<MDTrade>::DecodeBlock(block, trades);
+    ASSERT_EQ(trades.size(), 4u);
+    EXPECT_EQ(trades[3].Id, 13u);
+    EXPECT_EQ(trades[3].Instrument, "ETHUSDT");
+    EXPECT_EQ(trades[2].Instrument, "BTCUSDT");
+    EXPECT_EQ(trades[3].Price, 103.5);
+    EXPECT_EQ(trades[3].Qty, 0.75);
+    EXPECT_EQ(trades[3].AggressorSide, Side::Sell);
+    EXPECT_EQ(trades[3].EventTimestamp, 1700000000003000000u);
+
+    MDTradeColumns columns;
+    ClickhouseBlockDecoder::DecodeTrades(block, columns);
+    ClickhouseBlockDecoder::DecodeTrades(block, columns);
+    ASSERT_EQ(columns.size(), 8u);
+    EXPECT_EQ(columns.Instruments.size(), 2u);
+    EXPECT_EQ(columns.Instruments[columns.InstrumentIds[7]], "ETHUSDT");
+    EXPECT_EQ(columns.Prices[6], 102.5);
+
+    Block quotes;
+    quotes.AppendColumn("id", id);
+    quotes.AppendColumn("symbol", symbol);
+    quotes.AppendColumn("bid_price", price);
+    quotes.AppendColumn("bid_qty", qty);
+    quotes.AppendColumn("ask_price", price);
+    quotes.AppendColumn("ask_qty", qty);
+    quotes.AppendColumn("timestamp", ts);
+
+    std::vector<MDL1Update> updates;
+    ClickhouseMarketDataFetcher<MDL1Update>::DecodeBlock(quotes, updates);
+    ASSERT_EQ(updates.size(), 4u);
+    EXPECT_EQ(updates[1].BidPrice, 101.5);
+    EXPECT_EQ(updates[1].AskQty, 0.25);
+    EXPECT_EQ(updates[1].Instrument, "ETHUSDT");
+    EXPECT_EQ(updates[1].EventTimestamp, 1700000000001000000u);
+
+    EXPECT_THROW(ClickhouseMarketDataFetcher<MDL1Update>::DecodeBlock(block, updates), std::runtime_error);
+}
+
+TEST(ClickhouseBlockDecoderTest, DateTime64Nanoseconds)
+{
+    using namespace clickhouse;
+
+    // The same instant at millisecond and nanosecond precision
+    auto millis = std::make_shared<ColumnDateTime64>(3);
+    auto nanos = std::make_shared<ColumnDateTime64>(9);
+    millis->Append(1700000000123);
+    nanos->Append(1700000000123456789);
+
+    std::vector<Timestamp> timestamps;
+    ClickhouseBlockDecoder::ToTimestamps(millis, timestamps);
+    ASSERT_EQ(timestamps.size(), 1u);
+    EXPECT_EQ(timestamps[0], 1700000000123000000u);
+    ClickhouseBlockDecoder::ToTimestamps(nanos, timestamps);
+    ASSERT_EQ(timestamps.size(), 1u);
+    EXPECT_EQ(timestamps[0], 1700000000123456789u);
+}
+
+TEST(ClickhouseBlockDecoderTest, PartitionTimeRange)
+{
+    auto ranges = ClickhouseMarketDataFetcher<MDTrade>::PartitionTimeRange(10, 21, 4);
+    ASSERT_EQ(ranges.size(), 4u);
+    EXPECT_EQ(ranges[0], std::make_pair(Timestamp(10), Timestamp(13)));
+    EXPECT_EQ(ranges[3], std::make_pair(Timestamp(19), Timestamp(21)));
+    for (size_t i = 1; i < ranges.size(); ++i)
+        EXPECT_EQ(ranges[i - 1].second, ranges[i].first);
+    EXPECT_EQ(ClickhouseMarketDataFetcher<MDTrade>::PartitionTimeRange(10, 12, 8).size(), 2u);
+    EXPECT_TRUE(ClickhouseMarketDataFetcher<MDTrade>::PartitionTimeRange(10, 10, 8).empty());
+}
@@ -11,4 +11,44 @@ TEST(ClickhouseMarketDataFetcherTest, FetchTrades)
 {
     auto result = ClickhouseMarketDataFetcher<MDTrade>::Fetch("localhost", 19000, "default", "root",
         "SELECT * FROM binance_futures_um_trades WHERE symbol = 'RAREUSDT'");
-}
\ No newline at end of file
+}
+
+TEST(ClickhouseMarketDataFetcherTest, StreamTrades)
+{
+    auto source = ClickhouseMarketDataFetcher<MDTrade>::Stream("localhost", 19000, "default", "root",
+        "SELECT * FROM binance_futures_um_trades WHERE symbol = 'RAREUSDT'", "timestamp");
+    MarketDataSimulationManager manager({MDRow(source, 1 << 16)});
+    Timestamp last = 0;
+    for (auto iter = manager.begin(); iter != manager.end(); ++iter)
+    {
+        EXPECT_LE(last, (*iter)->EventTimestamp);
+        last = (*iter)->EventTimestamp;
+    }
+}
+
+TEST(ClickhouseMarketDataFetcherTest, FetchTradesThroughCache)
+{
+    TickFileCache cache(std::filesystem::temp_directory_path() / "crpt_clickhouse_cache", 1ull << 30);
+    std::string query = "SELECT * FROM binance_futures_um_trades WHERE symbol = 'RAREUSDT'";
+    cache.Invalidate(ClickhouseMarketDataFetcher<MDTrade>::CacheKey("localhost", 19000, "default", query));
+
+    auto fetched = ClickhouseMarketDataFetcher<MDTrade>::Fetch("localhost", 19000, "default", "root", query, cache);
+    auto cached = ClickhouseMarketDataFetcher<MDTrade>::Fetch("localhost", 19000, "default", "root", query + " ;", cache);
+    ASSERT_EQ(cached.size(), fetched.size());
+    for (size_t i = 0; i < cached.size(); ++i)
+        EXPECT_EQ(cached[i].EventTimestamp, fetched[i].EventTimestamp);
+}
+
+TEST(ClickhouseMarketDataFetcherTest, FetchTradesPartitioned)
+{
+    std::string query = "SELECT * FROM binance_futures_um_trades WHERE symbol = 'RAREUSDT'";
+    auto ordered = ClickhouseMarketDataFetcher<MDTrade>::Fetch("localhost", 19000, "default", "root", query + " ORDER BY timestamp");
+    ASSERT_FALSE(ordered.empty());
+    Timestamp start = ordered.front().EventTimestamp, end = ordered.back().EventTimestamp + 1;
+
+    auto partitioned = ClickhouseMarketDataFetcher<MDTrade>::FetchPartitioned("localhost", 19000, "default", "root",
+                                                                              query, "timestamp", start, end, 4);
+    ASSERT_EQ(partitioned.size(), ordered.size());
+    for (size_t i = 0; i < partitioned.size(); ++i)
+        EXPECT_EQ(partitioned[i].EventTimestamp, ordered[i].EventTimestamp);
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "../src/utils/csv_reader.hpp"
+
+using namespace CRPT::Utils;
+
+struct CSVTestRecord
+{
+    u_int64_t Timestamp{0};
+    double Value{0};
+    std::string Text;
+};
+
+TEST(CSVReaderTests, SchemaAndProjection)
+{
+    std::string buffer = "ts,value,skipped,text\n"
+                         "1,1.5,garbage,first\r\n"
+                         "\n"
+                         "2,-2e3,garbage,second\n"
+                         "3,0.25,garbage,third";
+
+    auto schema = CSVSchema<CSVTestRecord>()
+                      .Column(3, [](std::string_view field, CSVTestRecord &record)
+                              { record.Text.assign(field); })
+                      .Column(0, [](std::string_view field, CSVTestRecord &record)
+                              { record.Timestamp = CSVField::ToUInt64(field); })
+                      .Column(1, [](std::string_view field, CSVTestRecord &record)
+                              { record.Value = CSVField::ToDouble(field); });
+
+    std::vector<CSVTestRecord> records;
+    EXPECT_EQ(CSVReader::FromBuffer(buffer).Read(schema, records, 1), 3u);
+    ASSERT_EQ(records.size(), 3u);
+    EXPECT_EQ(records[0].Timestamp, 1u);
+    EXPECT_EQ(records[0].Value, 1.5);
+    EXPECT_EQ(records[0].Text, "first");
+    EXPECT_EQ(records[1].Value, -2000.);
+    EXPECT_EQ(records[2].Timestamp, 3u);
+    EXPECT_EQ(records[2].Text, "third");
+
+    records.clear();
+    EXPECT_THROW(CSVReader::FromBuffer(buffer).Read(schema, records), std::runtime_error);
+    EXPECT_THROW(CSVReader::FromBuffer("1,2").Read(schema, records), std::runtime_error);
+}
+
+TEST(CSVReaderTests, Fields)
+{
+    EXPECT_EQ(CSVField::ToUInt64("1700000000000000000"), 1700000000000000000ull);
+    EXPECT_THROW(CSVField::ToUInt64("12a"), std::runtime_error);
+    EXPECT_EQ(CSVField::ToDouble("0.1"), 0.1);
+    EXPECT_THROW(CSVField::ToDouble(""), std::runtime_error);
+    EXPECT_TRUE(CSVField::IEquals("BuY", "buy"));
+    EXPECT_FALSE(CSVField::IEquals("sell", "buy"));
+}
+
+TEST(CSVReaderTests, SplitAtLineBoundaries)
+{
+    std::string buffer;
+    for (int i = 0; i < 1000; ++i)
+        buffer += std::to_string(i) + "," + std::to_string(i * 0.5) + ",text\n";
+    buffer += "1000,500,text";
+
+    auto schema = CSVSchema<CSVTestRecord>()
+                      .Column(0, [](std::string_view field, CSVTestRecord &record)
+                              { record.Timestamp = CSVField::ToUInt64(field); });
+
+    for (size_t pieces : {1, 3, 7, 64, 100000})
+    {
+        auto readers = CSVReader::FromBuffer(buffer).Split(pieces);
+        EXPECT_LE(readers.size(), std::min<size_t>(pieces, 1001));
+        std::vector<CSVTestRecord> records;
+        for (auto &reader : readers)
+            reader.Read(schema, records);
+        ASSERT_EQ(records.size(), 1001u);
+        for (size_t i = 0; i < records.size(); ++i)
+            EXPECT_EQ(records[i].Timestamp, i);
+    }
+    EXPECT_TRUE(CSVReader::FromBuffer("").Split(4).empty());
+
+    // Errors in any part report the line in the whole buffer
+    buffer.replace(buffer.find("\n700,"), 5, "\nbad,");
+    std::string message;
+    try
+    {
+        std::vector<CSVTestRecord> records;
+        for (auto &reader : CSVReader::FromBuffer(buffer).SkipLines(1).Split(7))
+            reader.Read(schema, records);
+    }
+    catch (const std::runtime_error &e)
+    {
+        message = e.what();
+    }
+    EXPECT_TRUE(message.ends_with(" at line 701")) << message;
+}
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <gtest/gtest.h>
+#include <random>
 
 #include "../src/core/market_data_simulation_manager.hpp"
+#include "../src/core/l2_book.hpp"
+#include "../src/core/tick_cache.hpp"
 
 using namespace CRPT::Core;
 using namespace CRPT::Utils;
@@ -84,4 +87,907 @@ TEST(MarketDataSimulationManagerTests, IteratorPlus)
             EXPECT_EQ(MDTradePtr(*iter)->Price, 2.);
         }
     }
-}
\ No newline at end of file
+}
+
+TEST(MarketDataSimulationManagerTests, IteratorManyRowsTieBreaking)
+{
+    const size_t nRows = 50;
+    std::vector<std::vector<MDCustomUpdate>> updates(nRows);
+    for (size_t r = 0; r < nRows; ++r)
+    {
+        for (size_t i = 0; i < 20 + r % 7; ++i)
+        {
+            MDCustomUpdate update;
+            update.EventTimestamp = (i * (r % 5 + 1)) / 2;
+            update.Payload = r;
+            updates[r].push_back(update);
+        }
+    }
+
+    std::vector<MDRow> rows;
+    for (auto &row : updates)
+        rows.emplace_back(row);
+    MarketDataSimulationManager manager(rows);
+
+    // Reference: the row with the smallest head wins, the greatest row index wins on ties
+    std::vector<size_t> counters(nRows, 0);
+    size_t total = 0;
+    for (auto iter = manager.begin(); iter != manager.end(); ++iter, ++total)
+    {
+        int argmin = -1;
+        for (size_t r = 0; r < nRows; ++r)
+            if (counters[r] < updates[r].size() &&
+                (argmin == -1 || updates[r][counters[r]].EventTimestamp <= updates[argmin][counters[argmin]].EventTimestamp))
+                argmin = r;
+        ASSERT_NE(argmin, -1);
+        EXPECT_EQ(*iter, &updates[argmin][counters[argmin]]);
+        ++counters[argmin];
+    }
+
+    size_t expected = 0;
+    for (auto &row : updates)
+        expected += row.size();
+    EXPECT_EQ(total, expected);
+}
+
+TEST(MarketDataSimulationManagerTests, IteratorPeekNext)
+{
+    std::vector<MDCustomUpdate> updates1(5, MDCustomUpdate());
+    std::vector<MDCustomUpdate> updates2(5, MDCustomUpdate());
+    for (size_t i = 0; i < updates1.size(); ++i)
+        updates1[i].EventTimestamp = i*2 + 1;
+    for (size_t i = 0; i < updates2.size(); ++i)
+        updates2[i].EventTimestamp = i*2;
+    MarketDataSimulationManager manager(std::vector<MDRow>{updates1, updates2});
+    auto iter = manager.begin();
+    for(Timestamp counter = 0; iter != manager.end(); ++iter, ++counter)
+    {
+        EXPECT_EQ(iter->EventTimestamp, counter);
+        if (counter < 9)
+        {
+            EXPECT_TRUE(iter.HasNext());
+            EXPECT_EQ(iter.PeekNextTimestamp(), counter + 1);
+        }
+        else
+            EXPECT_FALSE(iter.HasNext());
+    }
+}
+
+TEST(MarketDataSimulationManagerTests, CompiledOrderReplay)
+{
+    std::vector<MDCustomUpdate> updates1(5, MDCustomUpdate());
+    std::vector<MDCustomUpdate> updates2(5, MDCustomUpdate());
+    std::vector<MDTrade> updates3(5, MDTrade());
+    for (size_t i = 0; i < updates1.size(); ++i)
+        updates1[i].EventTimestamp = i*3;
+    for (size_t i = 0; i < updates2.size(); ++i)
+        updates2[i].EventTimestamp = i*3 + 1;
+    for (size_t i = 0; i < updates3.size(); ++i)
+        updates3[i].EventTimestamp = i*3 + 1;
+
+    MarketDataSimulationManager manager(std::vector<MDRow>{updates1, updates2, updates3});
+    std::vector<MarketDataUpdatePtr> merged;
+    for (auto iter = manager.begin(); iter != manager.end(); ++iter)
+        merged.push_back(*iter);
+
+    manager.CompileOrder();
+    ASSERT_TRUE(manager.HasCompiledOrder());
+    EXPECT_EQ(manager.GetCompiledOrder().size(), 15u);
+
+    std::string path = std::filesystem::temp_directory_path() / "crpt_compiled_order_test.bin";
+    manager.SaveOrder(path);
+
+    MarketDataSimulationManager replayed(std::vector<MDRow>{updates1, updates2, updates3});
+    replayed.LoadOrder(path);
+    for (auto *mgr : {&manager, &replayed})
+    {
+        size_t i = 0;
+        for (auto iter = mgr->begin(); iter != mgr->end(); ++iter, ++i)
+        {
+            ASSERT_LT(i, merged.size());
+            EXPECT_EQ(*iter, merged[i]);
+            if (i + 1 < merged.size())
+                EXPECT_EQ(iter.PeekNextTimestamp(), merged[i + 1]->EventTimestamp);
+            else
+                EXPECT_FALSE(iter.HasNext());
+        }
+        EXPECT_EQ(i, merged.size());
+    }
+
+    MarketDataSimulationManager other(std::vector<MDRow>{updates1, updates2});
+    EXPECT_THROW(other.LoadOrder(path), std::runtime_error);
+
+    // A step out of its row's range is rejected
+    {
+        std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+        file.seekp(-(std::streamoff)sizeof(MarketDataSimulationManager::MergeStep), std::ios::end);
+        MarketDataSimulationManager::MergeStep step{0, 1000};
+        file.write((const char *)&step, sizeof(step));
+    }
+    MarketDataSimulationManager corrupted(std::vector<MDRow>{updates1, updates2, updates3});
+    EXPECT_THROW(corrupted.LoadOrder(path), std::runtime_error);
+    EXPECT_FALSE(corrupted.HasCompiledOrder());
+    std::filesystem::remove(path);
+}
+
+TEST(MarketDataSimulationManagerTests, StreamingRows)
+{
+    std::vector<MDCustomUpdate> updates1(50, MDCustomUpdate());
+    for (size_t i = 0; i < updates1.size(); ++i)
+        updates1[i].EventTimestamp = i*2 + 1;
+
+    size_t generated = 0, maxChunk = 0;
+    auto source = std::make_shared<GeneratorMDRowSource<MDCustomUpdate>>(
+        [&](std::vector<MDCustomUpdate> &chunk, size_t maxSize)
+        {
+            maxChunk = std::max(maxChunk, maxSize);
+            size_t count = 0;
+            for (; count < maxSize && generated < 50; ++count, ++generated)
+            {
+                MDCustomUpdate update;
+                update.EventTimestamp = generated * 2;
+                update.Payload = generated;
+                chunk.push_back(update);
+            }
+            return count;
+        },
+        [&]()
+        { generated = 0; });
+
+    MarketDataSimulationManager manager(std::vector<MDRow>{updates1, MDRow(MDRowSourcePtr<MDCustomUpdate>(source), 8)});
+    for (int run = 0; run < 2; ++run)
+    {
+        Timestamp counter = 0;
+        for (auto iter = manager.begin(); iter != manager.end(); ++iter, ++counter)
+        {
+            EXPECT_EQ(iter->EventTimestamp, counter);
+            if (counter % 2 == 0)
+            {
+                EXPECT_EQ(MDCustomUpdatePtr(*iter)->Payload, double(counter / 2));
+            }
+        }
+        EXPECT_EQ(counter, 100u);
+    }
+    EXPECT_EQ(maxChunk, 8u);
+    EXPECT_THROW(manager.CompileOrder(), std::runtime_error);
+}
+
+TEST(MarketDataSimulationManagerTests, BackgroundSource)
+{
+    // Recorded blocks standing in for a server streaming a query result
+    std::vector<std::vector<MDTrade>> blocks(20);
+    for (size_t b = 0; b < blocks.size(); ++b)
+        for (size_t i = 0; i < b % 5; ++i)
+            blocks[b].emplace_back().EventTimestamp = b * 10 + i;
+    std::atomic<int> runs{0};
+    auto producer = [&](const BackgroundMDRowSource<MDTrade>::Push &push)
+    {
+        ++runs;
+        for (auto block : blocks)
+            if (!push(std::move(block)))
+                return;
+    };
+
+    auto source = std::make_shared<BackgroundMDRowSource<MDTrade>>(producer, 2);
+    MarketDataSimulationManager manager({MDRow(MDRowSourcePtr<MDTrade>(source), 3)});
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        std::vector<Timestamp> timestamps;
+        for (auto iter = manager.begin(); iter != manager.end(); ++iter)
+            timestamps.push_back((*iter)->EventTimestamp);
+        ASSERT_EQ(timestamps.size(), 40u);
+        EXPECT_TRUE(std::is_sorted(timestamps.begin(), timestamps.end()));
+        EXPECT_EQ(timestamps.front(), 10u);
+        EXPECT_EQ(timestamps.back(), 193u);
+    }
+    // One run per pass, rewinding an unread source does not start it
+    EXPECT_EQ(runs, 2);
+
+    // Destroying a source stops a producer blocked on the full queue
+    {
+        BackgroundMDRowSource<MDTrade> stopped(producer, 1);
+        std::vector<MDTrade> chunk;
+        stopped.Read(chunk, 1);
+    }
+
+    BackgroundMDRowSource<MDTrade> failing([&](const BackgroundMDRowSource<MDTrade>::Push &push)
+                                           {
+                                               push(std::vector<MDTrade>(blocks[3]));
+                                               throw std::runtime_error("Connection lost"); });
+    std::vector<MDTrade> chunk;
+    EXPECT_EQ(failing.Read(chunk, 2), 2u);
+    EXPECT_THROW(failing.Read(chunk, 10), std::runtime_error);
+    EXPECT_EQ(chunk.size(), 3u);
+}
+
+TEST(MarketDataSimulationManagerTests, CSVTradesSource)
+{
+    CSVMarketDataTradesManager dataCollection({"../../data/simulation_test_trades_5.csv"});
+    auto &trades = dataCollection.GetTrades();
+
+    MDRow row(MDRowSourcePtr<MDTrade>(std::make_shared<CSVMarketDataTradesSource>("../../data/simulation_test_trades_5.csv")), 2);
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        auto trade = MDTradePtr(row[i]);
+        ASSERT_NE(trade, nullptr);
+        EXPECT_EQ(trade->EventTimestamp, trades[i].EventTimestamp);
+        EXPECT_EQ(trade->Price, trades[i].Price);
+        EXPECT_EQ(trade->AggressorSide, trades[i].AggressorSide);
+        EXPECT_EQ(trade->Instrument, trades[i].Instrument);
+    }
+    EXPECT_EQ(row[trades.size()], nullptr);
+    EXPECT_THROW(row[0], std::runtime_error);
+}
+
+TEST(MarketDataSimulationManagerTests, ParallelCSVIngestion)
+{
+    // Two interleaved files, large enough to be split into several chunks
+    std::vector<std::string> paths;
+    for (int file = 0; file < 2; ++file)
+    {
+        paths.push_back(std::filesystem::temp_directory_path() / ("crpt_parallel_trades_" + std::to_string(file) + ".csv"));
+        std::ofstream out(paths.back());
+        for (int i = 0; i < 60000; ++i)
+            out << (i / 3) * 2 + file << "," << 100 + i % 7 << "," << i << "," << (i % 2 ? "buy" : "sell") << ",BTCUSDT\n";
+    }
+
+    CSVMarketDataTradesManager single(paths, 1);
+    CSVMarketDataTradesManager parallel(paths, 4);
+    auto &expected = single.GetTrades();
+    auto &trades = parallel.GetTrades();
+    ASSERT_EQ(expected.size(), 120000u);
+    ASSERT_EQ(trades.size(), expected.size());
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        ASSERT_EQ(trades[i].EventTimestamp, expected[i].EventTimestamp);
+        ASSERT_EQ(trades[i].Qty, expected[i].Qty);
+        ASSERT_EQ(trades[i].AggressorSide, expected[i].AggressorSide);
+        if (i > 0)
+        {
+            ASSERT_LE(trades[i - 1].EventTimestamp, trades[i].EventTimestamp);
+        }
+    }
+    for (auto &path : paths)
+        std::filesystem::remove(path);
+}
+
+TEST(MarketDataSimulationManagerTests, CSVQuotesAndCustomLoaders)
+{
+    CSVMarketDataL1Manager quotes({"../../data/simulation_test_quotes_0.csv"});
+    auto &updates = quotes.GetUpdates();
+    ASSERT_EQ(updates.size(), 6u);
+    EXPECT_EQ(updates[2].EventTimestamp, 13u);
+    EXPECT_EQ(updates[2].BidPrice, 95);
+    EXPECT_EQ(updates[2].BidQty, 1);
+    EXPECT_EQ(updates[2].AskPrice, 96);
+    EXPECT_EQ(updates[1].BidQty, 2);
+    EXPECT_EQ(updates[2].Instrument, "TestInstrument");
+    EXPECT_EQ(updates[2].Type, MarketDataType::L1Update);
+
+    std::string path = std::filesystem::temp_directory_path() / "crpt_custom_series.csv";
+    {
+        std::ofstream out(path);
+        out << "ts,midprice,garbage,spread\n"
+            << "20,10.5,x,0.1\n"
+            << "10,11.5,y,0.2\n";
+    }
+
+    CSVMarketDataCustomManager custom({path}, "ttf", 3);
+    auto &series = custom.GetUpdates();
+    ASSERT_EQ(series.size(), 2u);
+    EXPECT_EQ(series[0].EventTimestamp, 10u);
+    EXPECT_EQ(series[0].Payload, 0.2);
+    EXPECT_EQ(series[0].Text, "ttf");
+
+    CSVMarketDataCustomMultipleManager multiple({path}, "ttf", {"spread", "midprice"});
+    auto &multipleSeries = multiple.GetUpdates();
+    ASSERT_EQ(multipleSeries.size(), 2u);
+    EXPECT_EQ(multipleSeries[1].EventTimestamp, 20u);
+    EXPECT_EQ(multipleSeries[1].Text, "ttf");
+    EXPECT_EQ(multipleSeries[1].Payload.size(), 2u);
+    EXPECT_EQ(multipleSeries[1].Payload["midprice"], 10.5);
+    EXPECT_EQ(multipleSeries[1].Payload["spread"], 0.1);
+
+    EXPECT_THROW(CSVMarketDataCustomMultipleManager({path}, "ttf", {"volume"}), std::runtime_error);
+    EXPECT_THROW(CSVMarketDataCustomMultipleManager({path}, "ttf"), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(MarketDataSimulationManagerTests, CSVSidecarCache)
+{
+    auto dir = std::filesystem::temp_directory_path() / "crpt_csv_cache_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+    std::string path = dir / "trades.csv";
+    {
+        std::ofstream out(path);
+        out << "20,101,1,buy,BTCUSDT\n10,100,2,sell,BTCUSDT\n";
+    }
+    auto caches = [&]()
+    {
+        std::vector<std::string> result;
+        for (auto &entry : std::filesystem::directory_iterator(dir))
+            if (entry.path().extension() == CSVCache::EXTENSION)
+                result.push_back(entry.path());
+        return result;
+    };
+
+    CSVMarketDataTradesManager uncached({path});
+    EXPECT_TRUE(caches().empty());
+
+    CSVMarketDataTradesManager first({path}, 1, true);
+    ASSERT_EQ(caches().size(), 1u);
+    std::string cachePath = caches()[0];
+    EXPECT_EQ(cachePath, CSVCache::Path(path, std::string(CSVMarketDataTradesManager::SCHEMA_KEY) + ":0"));
+    ASSERT_EQ(first.GetTrades().size(), 2u);
+    EXPECT_EQ(first.GetTrades()[0].EventTimestamp, 10u);
+
+    // A fresh cache is read instead of the CSV
+    std::vector<MDTrade> fake(1);
+    fake[0].EventTimestamp = 5;
+    fake[0].Instrument = "FAKE";
+    TickStore::Write(cachePath, fake);
+    CSVMarketDataTradesManager cached({path}, 1, true);
+    ASSERT_EQ(cached.GetTrades().size(), 1u);
+    EXPECT_EQ(cached.GetTrades()[0].Instrument, "FAKE");
+
+    // A changed CSV misses the cache, which is replaced. The cache of another schema key
+    // is left alone.
+    std::string otherPath = CSVCache::Path(path, "other:0");
+    CSVCache::Store(path, otherPath, fake);
+    ASSERT_EQ(caches().size(), 2u);
+    {
+        std::ofstream out(path, std::ios::app);
+        out << "30,102,3,buy,BTCUSDT\n";
+    }
+    CSVMarketDataTradesManager changed({path}, 1, true);
+    ASSERT_EQ(changed.GetTrades().size(), 3u);
+    EXPECT_EQ(changed.GetTrades()[2].EventTimestamp, 30u);
+    ASSERT_EQ(caches().size(), 2u);
+    EXPECT_FALSE(std::filesystem::exists(cachePath));
+    EXPECT_TRUE(std::filesystem::exists(otherPath));
+
+    // Only types with a tick file layout can be cached
+    EXPECT_THROW(CSVMarketDataManager<MDCustomUpdate>({path}, CSVSchema<MDCustomUpdate>(), 1, 0, "custom"), std::runtime_error);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(TickStoreTests, WriteAndMapTrades)
+{
+    CSVMarketDataTradesManager dataCollection({"../../data/simulation_test_trades_6.csv"});
+    auto &trades = dataCollection.GetTrades();
+    std::string path = std::filesystem::temp_directory_path() / "crpt_tick_store_trades.bin";
+    TickStore::Write(path, trades);
+
+    MDRow row(path, 2);
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        auto trade = MDTradePtr(row[i]);
+        ASSERT_NE(trade, nullptr);
+        EXPECT_EQ(trade->Type, MarketDataType::Trade);
+        EXPECT_EQ(trade->EventTimestamp, trades[i].EventTimestamp);
+        EXPECT_EQ(trade->Price, trades[i].Price);
+        EXPECT_EQ(trade->Qty, trades[i].Qty);
+        EXPECT_EQ(trade->AggressorSide, trades[i].AggressorSide);
+        EXPECT_EQ(trade->Instrument, trades[i].Instrument);
+    }
+    EXPECT_EQ(row[trades.size()], nullptr);
+    std::filesystem::remove(path);
+}
+
+TEST(TickStoreTests, RejectsCorruptedFiles)
+{
+    CSVMarketDataTradesManager dataCollection({"../../data/simulation_test_trades_6.csv"});
+    auto &trades = dataCollection.GetTrades();
+    std::string path = std::filesystem::temp_directory_path() / "crpt_tick_store_corrupted.bin";
+    auto patch = [&](size_t offset, u_int64_t value, size_t size)
+    {
+        TickStore::Write(path, trades);
+        std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+        file.seekp(offset);
+        file.write((const char *)&value, size);
+    };
+
+    TickStore::Write(path, trades);
+    u_int64_t recordsOffset = std::filesystem::file_size(path) - trades.size() * sizeof(TickStore::TradeRecord);
+
+    // A record count whose byte size overflows
+    patch(offsetof(TickStore::TickFileHeader, RecordCount), 1ull << 61, sizeof(u_int64_t));
+    EXPECT_THROW(TickStore::MappedTickFile{path}, std::runtime_error);
+
+    patch(offsetof(TickStore::TickFileHeader, RecordsOffset), recordsOffset + 1, sizeof(u_int64_t));
+    EXPECT_THROW(TickStore::MappedTickFile{path}, std::runtime_error);
+
+    patch(recordsOffset + offsetof(TickStore::TradeRecord, Instrument), 7, sizeof(u_int32_t));
+    std::vector<MDTrade> out;
+    EXPECT_THROW(TickStore::Read(path, out), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(TickStoreTests, WriteAndMapL1Updates)
+{
+    std::vector<MDL1Update> updates;
+    for (int i = 0; i < 10; ++i)
+    {
+        MDL1Update update;
+        update.AskPrice = 100 + i;
+        update.BidPrice = 90 - i;
+        update.AskQty = 1;
+        update.BidQty = 2;
+        update.Instrument = i % 2 ? "A" : "B";
+        update.EventTimestamp = i;
+        updates.push_back(update);
+    }
+    std::string path = std::filesystem::temp_directory_path() / "crpt_tick_store_l1.bin";
+    TickStore::Write(path, updates);
+
+    auto file = std::make_shared<TickStore::MappedTickFile>(path);
+    EXPECT_EQ(file->GetDataType(), MarketDataType::L1Update);
+    EXPECT_EQ(file->size(), updates.size());
+    EXPECT_THROW(TickStore::MappedTickSource<MDTrade>{file}, std::runtime_error);
+
+    MarketDataSimulationManager manager({MDRow(file, 4)});
+    size_t i = 0;
+    for (auto iter = manager.begin(); iter != manager.end(); ++iter, ++i)
+    {
+        auto update = MDL1UpdatePtr(*iter);
+        EXPECT_EQ(update->EventTimestamp, updates[i].EventTimestamp);
+        EXPECT_EQ(update->AskPrice, updates[i].AskPrice);
+        EXPECT_EQ(update->BidQty, updates[i].BidQty);
+        EXPECT_EQ(update->Instrument, updates[i].Instrument);
+    }
+    EXPECT_EQ(i, updates.size());
+    std::filesystem::remove(path);
+}
+
+TEST(TickStoreTests, TickFileCache)
+{
+    EXPECT_EQ(TickFileCache::NormalizeQuery("  SELECT *\n  FROM t\tWHERE s = 'a  b' ;\n"), "SELECT * FROM t WHERE s = 'a  b'");
+    EXPECT_EQ(TickFileCache::NormalizeQuery("SELECT 'it\\'s  ok'"), "SELECT 'it\\'s  ok'");
+    EXPECT_EQ(TickFileCache::Key("server", "SELECT  1;"), TickFileCache::Key("server", "SELECT 1"));
+    EXPECT_NE(TickFileCache::Key("server", "SELECT 1"), TickFileCache::Key("other", "SELECT 1"));
+    EXPECT_NE(TickFileCache::Key("server", "SELECT 'a  b'"), TickFileCache::Key("server", "SELECT 'a b'"));
+
+    auto dir = std::filesystem::temp_directory_path() / "crpt_tick_file_cache";
+    std::filesystem::remove_all(dir);
+    std::vector<MDTrade> trades(1000);
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        trades[i].EventTimestamp = i;
+        trades[i].Instrument = "BTCUSDT";
+    }
+
+    TickFileCache unlimited(dir);
+    std::vector<MDTrade> loaded;
+    EXPECT_FALSE(unlimited.Load("a", loaded));
+    EXPECT_TRUE(unlimited.Store("a", trades));
+    ASSERT_TRUE(unlimited.Load("a", loaded));
+    ASSERT_EQ(loaded.size(), trades.size());
+    EXPECT_EQ(loaded[999].EventTimestamp, 999u);
+    EXPECT_EQ(loaded[999].Instrument, "BTCUSDT");
+    u_int64_t entrySize = unlimited.Size();
+
+    unlimited.Invalidate("a");
+    loaded.clear();
+    EXPECT_FALSE(unlimited.Load("a", loaded));
+
+    // A store that can't be written reports it instead of throwing
+    EXPECT_FALSE(unlimited.Store("missing/a", trades));
+    EXPECT_EQ(unlimited.Size(), 0u);
+    EXPECT_NE(CRPT::Utils::Helpers::GetUniqueSuffix(), CRPT::Utils::Helpers::GetUniqueSuffix());
+
+    // Room for two entries: storing a third evicts the least recently used one
+    TickFileCache limited(dir, 2 * entrySize + entrySize / 2);
+    auto age = [&](const std::string &key, int seconds)
+    {
+        std::filesystem::last_write_time(limited.Path(key), std::filesystem::file_time_type::clock::now() - std::chrono::seconds(seconds));
+    };
+    limited.Store("a", trades);
+    age("a", 20);
+    limited.Store("b", trades);
+    age("b", 10);
+    EXPECT_TRUE(limited.Load("a", loaded));
+    limited.Store("c", trades);
+    EXPECT_TRUE(std::filesystem::exists(limited.Path("a")));
+    EXPECT_FALSE(std::filesystem::exists(limited.Path("b")));
+    EXPECT_TRUE(std::filesystem::exists(limited.Path("c")));
+    EXPECT_LE(limited.Size(), 2 * entrySize + entrySize / 2);
+
+    limited.Clear();
+    EXPECT_EQ(limited.Size(), 0u);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(TickStoreTests, CompressedTradesRoundTrip)
+{
+    std::mt19937_64 rng(7);
+    std::vector<MDTrade> trades(10000);
+    Timestamp ts = 1700000000000000000;
+    double price = 50000;
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        ts += rng() % 3 == 0 ? 0 : 1000 + rng() % 500;
+        price += (int(rng() % 5) - 2) * 0.01;
+        trades[i].Id = 1000 + i;
+        trades[i].EventTimestamp = ts;
+        trades[i].LocalTimestamp = ts + rng() % 100;
+        trades[i].Price = i % 1000 == 0 ? 1.0 / 3 : std::round(price * 100) / 100;
+        trades[i].Qty = i % 777 == 0 ? 1e-12 : double(rng() % 100000) / 1000;
+        trades[i].AggressorSide = rng() % 2 ? Side::Buy : Side::Sell;
+        trades[i].Instrument = i % 3 ? "BTCUSDT" : "ETHUSDT";
+    }
+
+    std::string path = std::filesystem::temp_directory_path() / "crpt_compressed_trades.bin";
+    std::string rawPath = std::filesystem::temp_directory_path() / "crpt_compressed_trades_raw.bin";
+    CompressedTickStore::Write(path, trades, {.PriceScale = 100, .QtyScale = 1000, .BlockSize = 1000});
+    TickStore::Write(rawPath, trades);
+    EXPECT_LT(std::filesystem::file_size(path) * 3, std::filesystem::file_size(rawPath));
+
+    auto file = std::make_shared<CompressedTickStore::CompressedTickFile>(path);
+    EXPECT_EQ(file->GetDataType(), MarketDataType::Trade);
+    EXPECT_EQ(file->size(), trades.size());
+    EXPECT_EQ(file->BlockCount(), 10u);
+    EXPECT_EQ(file->GetBlock(3).FirstTimestamp, trades[3000].EventTimestamp);
+    EXPECT_EQ(file->GetBlock(3).LastTimestamp, trades[3999].EventTimestamp);
+    EXPECT_THROW(CompressedTickStore::CompressedTickSource<MDL1Update>{file}, std::runtime_error);
+
+    MDRow row(path, 333);
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        auto trade = MDTradePtr(row[i]);
+        ASSERT_NE(trade, nullptr);
+        ASSERT_EQ(trade->Id, trades[i].Id);
+        ASSERT_EQ(trade->EventTimestamp, trades[i].EventTimestamp);
+        ASSERT_EQ(trade->LocalTimestamp, trades[i].LocalTimestamp);
+        ASSERT_EQ(trade->Price, trades[i].Price);
+        ASSERT_EQ(trade->Qty, trades[i].Qty);
+        ASSERT_EQ(trade->AggressorSide, trades[i].AggressorSide);
+        ASSERT_EQ(trade->Instrument, trades[i].Instrument);
+    }
+    EXPECT_EQ(row[trades.size()], nullptr);
+
+    // Decoding from a timestamp skips the blocks before it
+    Timestamp from = trades[4321].EventTimestamp;
+    size_t first = 4321;
+    while (first > 0 && trades[first - 1].EventTimestamp == from)
+        --first;
+    CompressedTickStore::CompressedTickSource<MDTrade> source(file, from);
+    std::vector<MDTrade> tail;
+    while (source.Read(tail, 500) > 0)
+        ;
+    ASSERT_EQ(tail.size(), trades.size() - first);
+    EXPECT_EQ(tail[0].Id, trades[first].Id);
+    source.Rewind();
+    tail.clear();
+    source.Read(tail, 1);
+    EXPECT_EQ(tail[0].Id, trades[first].Id);
+
+    // Both layouts seek without reading the records before the block, so the chunks
+    // before the seek position were never pulled
+    for (auto &seekPath : {path, rawPath})
+    {
+        MDRow seekRow(seekPath, 333);
+        ASSERT_EQ(seekRow.Seek(from), first);
+        EXPECT_EQ(MDTradePtr(seekRow[first])->Id, trades[first].Id);
+        EXPECT_THROW(seekRow[first - 400], std::runtime_error);
+        EXPECT_EQ(seekRow.Seek(trades.back().EventTimestamp + 1), trades.size());
+    }
+
+    std::filesystem::remove(path);
+    std::filesystem::remove(rawPath);
+}
+
+TEST(TickStoreTests, CompressedL1Updates)
+{
+    std::vector<MDL1Update> updates;
+    for (int i = 0; i < 10; ++i)
+    {
+        MDL1Update update;
+        update.Id = i;
+        update.AskPrice = 100.25 + i;
+        update.BidPrice = 90.5 - i;
+        update.AskQty = 1.5;
+        update.BidQty = 2;
+        update.Qty = 0;
+        update.Instrument = i % 2 ? "A" : "B";
+        update.EventTimestamp = i * 10;
+        update.LocalTimestamp = i * 10 + 1;
+        updates.push_back(update);
+    }
+    std::string path = std::filesystem::temp_directory_path() / "crpt_compressed_l1.bin";
+    CompressedTickStore::Write(path, updates, {.BlockSize = 4});
+
+    MarketDataSimulationManager manager({MDRow(path, 3)});
+    size_t i = 0;
+    for (auto iter = manager.begin(); iter != manager.end(); ++iter, ++i)
+    {
+        auto update = MDL1UpdatePtr(*iter);
+        EXPECT_EQ(update->Type, MarketDataType::L1Update);
+        EXPECT_EQ(update->EventTimestamp, updates[i].EventTimestamp);
+        EXPECT_EQ(update->LocalTimestamp, updates[i].LocalTimestamp);
+        EXPECT_EQ(update->AskPrice, updates[i].AskPrice);
+        EXPECT_EQ(update->BidPrice, updates[i].BidPrice);
+        EXPECT_EQ(update->AskQty, updates[i].AskQty);
+        EXPECT_EQ(update->BidQty, updates[i].BidQty);
+        EXPECT_EQ(update->Instrument, updates[i].Instrument);
+    }
+    EXPECT_EQ(i, updates.size());
+    std::filesystem::remove(path);
+}
+
+TEST(TickStoreTests, CompressedBlockOverrun)
+{
+    std::vector<MDTrade> trades(10);
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        trades[i].EventTimestamp = i;
+        trades[i].Price = 100;
+        trades[i].Qty = 1;
+        trades[i].Instrument = "BTCUSDT";
+    }
+    std::string path = std::filesystem::temp_directory_path() / "crpt_compressed_overrun.bin";
+    CompressedTickStore::Write(path, trades);
+
+    // A file and block claiming more records than the block holds
+    CompressedTickStore::CompressedFileHeader header;
+    u_int64_t blockOffset;
+    {
+        std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+        file.read((char *)&header, sizeof(header));
+        file.seekg(header.IndexOffset);
+        file.read((char *)&blockOffset, sizeof(blockOffset));
+        u_int32_t recordCount = trades.size() + 1;
+        file.seekp(blockOffset + offsetof(CompressedTickStore::BlockHeader, RecordCount));
+        file.write((const char *)&recordCount, sizeof(recordCount));
+        header.RecordCount = recordCount;
+        file.seekp(0);
+        file.write((const char *)&header, sizeof(header));
+    }
+    CompressedTickStore::CompressedTickSource<MDTrade> source(std::make_shared<CompressedTickStore::CompressedTickFile>(path));
+    std::vector<MDTrade> out;
+    EXPECT_THROW(source.Read(out, 100), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(TickStoreTests, CompressedCorruptedIndex)
+{
+    std::vector<MDTrade> trades(10);
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        trades[i].EventTimestamp = i;
+        trades[i].Price = 100;
+        trades[i].Qty = 1;
+        trades[i].Instrument = "BTCUSDT";
+    }
+    std::string path = std::filesystem::temp_directory_path() / "crpt_compressed_index.bin";
+
+    // Index entries pointing far outside the file and at the last bytes of the address space
+    for (u_int64_t blockOffset : {u_int64_t(1) << 40, u_int64_t(18446744073709551600ull)})
+    {
+        CompressedTickStore::Write(path, trades);
+        {
+            std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+            CompressedTickStore::CompressedFileHeader header;
+            file.read((char *)&header, sizeof(header));
+            file.seekp(header.IndexOffset);
+            file.write((const char *)&blockOffset, sizeof(blockOffset));
+        }
+        EXPECT_THROW(CompressedTickStore::CompressedTickFile{path}, std::runtime_error);
+    }
+
+    // A block count whose index size overflows
+    CompressedTickStore::Write(path, trades);
+    {
+        std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+        CompressedTickStore::CompressedFileHeader header;
+        file.read((char *)&header, sizeof(header));
+        header.BlockCount = u_int64_t(1) << 61;
+        file.seekp(0);
+        file.write((const char *)&header, sizeof(header));
+    }
+    EXPECT_THROW(CompressedTickStore::CompressedTickFile{path}, std::runtime_error);
+
+    // A block whose first record doesn't follow the previous blocks
+    CompressedTickStore::Write(path, trades);
+    {
+        std::fstream file{path, std::ios::binary | std::ios::in | std::ios::out};
+        CompressedTickStore::CompressedFileHeader header;
+        u_int64_t blockOffset;
+        file.read((char *)&header, sizeof(header));
+        file.seekg(header.IndexOffset);
+        file.read((char *)&blockOffset, sizeof(blockOffset));
+        u_int64_t firstRecord = 5;
+        file.seekp(blockOffset + offsetof(CompressedTickStore::BlockHeader, FirstRecord));
+        file.write((const char *)&firstRecord, sizeof(firstRecord));
+    }
+    EXPECT_THROW(CompressedTickStore::CompressedTickFile{path}, std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(MarketDataSimulationManagerTests, ColumnarTradesRow)
+{
+    std::vector<MDTrade> trades(20, MDTrade());
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        trades[i].EventTimestamp = i * 2;
+        trades[i].Price = 100 + i;
+        trades[i].Qty = i;
+        trades[i].AggressorSide = i % 2 ? Side::Buy : Side::Sell;
+        trades[i].Instrument = i % 3 ? "A" : "B";
+    }
+    auto columns = std::make_shared<MDTradeColumns>(trades);
+    EXPECT_EQ(columns->size(), trades.size());
+    EXPECT_EQ(columns->Instruments.size(), 2u);
+
+    std::vector<MDCustomUpdate> updates(20, MDCustomUpdate());
+    for (size_t i = 0; i < updates.size(); ++i)
+        updates[i].EventTimestamp = i * 2 + 1;
+
+    MarketDataSimulationManager manager({MDRow(columns, "trades"), MDRow(updates)});
+    size_t i = 0;
+    for (auto iter = manager.begin(); iter != manager.end(); ++iter, ++i)
+    {
+        EXPECT_EQ(iter->EventTimestamp, i);
+        if (iter->Type == MarketDataType::Trade)
+        {
+            auto trade = MDTradePtr(*iter);
+            auto &expected = trades[i / 2];
+            EXPECT_EQ(trade->Price, expected.Price);
+            EXPECT_EQ(trade->Qty, expected.Qty);
+            EXPECT_EQ(trade->AggressorSide, expected.AggressorSide);
+            EXPECT_EQ(trade->Instrument, expected.Instrument);
+        }
+    }
+    EXPECT_EQ(i, 40u);
+}
+
+TEST(MarketDataSimulationManagerTests, TimestampWindow)
+{
+    std::vector<MDCustomUpdate> updates1(50, MDCustomUpdate());
+    std::vector<MDTrade> trades(50, MDTrade());
+    for (size_t i = 0; i < updates1.size(); ++i)
+        updates1[i].EventTimestamp = i*2 + 1;
+    for (size_t i = 0; i < trades.size(); ++i)
+        trades[i].EventTimestamp = i*2;
+    auto columns = std::make_shared<MDTradeColumns>(trades);
+
+    size_t generated = 0;
+    auto source = std::make_shared<GeneratorMDRowSource<MDCustomUpdate>>(
+        [&](std::vector<MDCustomUpdate> &chunk, size_t maxSize)
+        {
+            size_t count = 0;
+            for (; count < maxSize && generated < 100; ++count, ++generated)
+            {
+                MDCustomUpdate update;
+                update.EventTimestamp = generated;
+                chunk.push_back(update);
+            }
+            return count;
+        },
+        [&]()
+        { generated = 0; });
+
+    EXPECT_EQ(MDRow(updates1).Seek(0), 0u);
+    EXPECT_EQ(MDRow(updates1).Seek(20), 10u);
+    EXPECT_EQ(MDRow(updates1).Seek(21), 10u);
+    EXPECT_EQ(MDRow(updates1).Seek(1000), 50u);
+    EXPECT_EQ(MDRow(columns).Seek(21), 11u);
+
+    MarketDataSimulationManager materialized(std::vector<MDRow>{updates1, trades});
+    MarketDataSimulationManager compiled(std::vector<MDRow>{updates1, trades});
+    compiled.CompileOrder();
+    MarketDataSimulationManager mixed(std::vector<MDRow>{MDRow(columns), MDRow(MDRowSourcePtr<MDCustomUpdate>(source), 8)});
+
+    for (auto *manager : {&materialized, &compiled, &mixed})
+    {
+        for (auto [start, end] : {std::pair<Timestamp, Timestamp>{20, 40}, {0, 5}, {95, 1000}, {37, 38}})
+        {
+            manager->SetWindow(start, end);
+            std::vector<Timestamp> timestamps;
+            for (auto iter = manager->begin(); iter != manager->end(); ++iter)
+            {
+                if (iter.HasNext())
+                {
+                    EXPECT_LT(iter.PeekNextTimestamp(), end);
+                }
+                timestamps.push_back(iter->EventTimestamp);
+            }
+            std::vector<Timestamp> expected;
+            for (Timestamp ts = start; ts < std::min<Timestamp>(end, 100); ++ts)
+                expected.push_back(ts);
+            if (manager == &mixed)
+            {
+                // The streaming row repeats every timestamp of the columnar row
+                expected.clear();
+                for (Timestamp ts = start; ts < std::min<Timestamp>(end, 100); ++ts)
+                {
+                    expected.push_back(ts);
+                    if (ts % 2 == 0)
+                        expected.push_back(ts);
+                }
+            }
+            EXPECT_EQ(timestamps, expected);
+        }
+        manager->ResetWindow();
+        size_t total = 0;
+        for (auto iter = manager->begin(); iter != manager->end(); ++iter)
+            ++total;
+        EXPECT_EQ(total, manager == &mixed ? 150u : 100u);
+    }
+}
+
+TEST(MarketDataSimulationManagerTests, PrefetchDistanceKeepsOrder)
+{
+    std::vector<std::vector<MDCustomUpdate>> updates(10);
+    for (size_t r = 0; r < updates.size(); ++r)
+        for (size_t i = 0; i < 30; ++i)
+        {
+            MDCustomUpdate update;
+            update.EventTimestamp = i * updates.size() + r;
+            updates[r].push_back(update);
+        }
+
+    MarketDataSimulationManager manager;
+    for (auto &row : updates)
+        manager.AddRow(MDRow{row});
+
+    for (bool compiled : {false, true})
+    {
+        if (compiled)
+            manager.CompileOrder();
+        for (size_t distance : {0, 1, 4, 64})
+        {
+            manager.SetPrefetchDistance(distance);
+            Timestamp counter = 0;
+            for (auto iter = manager.begin(); iter != manager.end(); ++iter, ++counter)
+                EXPECT_EQ(iter->EventTimestamp, counter);
+            EXPECT_EQ(counter, 300u);
+        }
+    }
+}
+
+TEST(MarketDataSimulationManagerTests, CSVDepthUpdates)
+{
+    CSVMarketDataL2Manager depth({"../../data/simulation_test_depth_0.csv"});
+    auto updates = depth.GetUpdates();
+    ASSERT_EQ(updates.size(), 4u);
+    EXPECT_TRUE(updates.Updates[0].Snapshot);
+    EXPECT_FALSE(updates.Updates[1].Snapshot);
+    ASSERT_EQ(updates.Updates[0].Bid.size(), 2u);
+    ASSERT_EQ(updates.Updates[0].Ask.size(), 2u);
+    EXPECT_EQ(updates.Updates[0].Bid[1].Price, 98);
+    EXPECT_EQ(updates.Updates[0].Ask[1].Qty, 3);
+    EXPECT_EQ(updates.Updates[3].Instrument, "TestInstrument");
+
+    // The copy views its own levels
+    EXPECT_EQ(updates.Updates[1].Ask.data(), updates.AskLevels.data() + 2);
+    EXPECT_NE(updates.Updates[1].Ask.data(), depth.GetUpdates().Updates[1].Ask.data());
+
+    MarketDataSimulationManager manager({MDRow{updates}});
+    L2Book book;
+    std::vector<Timestamp> timestamps;
+    for (auto update : manager)
+    {
+        ASSERT_EQ(update->Type, MarketDataType::L2Update);
+        timestamps.push_back(update->EventTimestamp);
+        book.Apply(*MDL2UpdatePtr(update));
+    }
+    EXPECT_EQ(timestamps, (std::vector<Timestamp>{10, 20, 30, 40}));
+    EXPECT_EQ(std::vector<double>(book.BidPrices().begin(), book.BidPrices().end()), (std::vector<double>{98, 99, 99.5}));
+    EXPECT_EQ(std::vector<double>(book.BidQtys().begin(), book.BidQtys().end()), (std::vector<double>{5, 2, 1}));
+    EXPECT_EQ(std::vector<double>(book.AskPrices().begin(), book.AskPrices().end()), (std::vector<double>{102, 100.5}));
+    EXPECT_EQ(book.GetBestBid(), 99.5);
+    EXPECT_EQ(book.GetBestAsk(), 100.5);
+    EXPECT_EQ(book.GetQty(Side::Buy, 99), 2);
+    EXPECT_EQ(book.GetQty(Side::Buy, 100.5), 0);
+
+    MDL2Update snapshot;
+    snapshot.Snapshot = true;
+    std::vector<MDL2Level> asks{{105, 1}, {106, 4}, {107, 2}};
+    snapshot.Ask = asks;
+    book.Apply(snapshot);
+    EXPECT_FALSE(book.GetBestBid().has_value());
+    EXPECT_EQ(book.GetBestAsk(), 105);
+    EXPECT_EQ(std::vector<double>(book.AskPrices().begin(), book.AskPrices().end()), (std::vector<double>{107, 106, 105}));
+    EXPECT_EQ(book.GetQty(Side::Sell, 106), 4);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include "../src/core/entity.hpp"
+#include "../src/utils/market_data_sorter.hpp"
+
+using namespace CRPT::Core;
+using namespace CRPT::Utils;
+
+static void ExpectSortedLikeStableSort(std::vector<MDTrade> trades, size_t threads)
+{
+    // Qty keeps the input position to check stability
+    for (size_t i = 0; i < trades.size(); ++i)
+        trades[i].Qty = i;
+    auto expected = trades;
+    std::stable_sort(expected.begin(), expected.end(), MarketDataSorter::Less<MDTrade>);
+    MarketDataSorter::Sort(trades, threads);
+    ASSERT_EQ(trades.size(), expected.size());
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        EXPECT_EQ(trades[i].EventTimestamp, expected[i].EventTimestamp);
+        EXPECT_EQ(trades[i].Id, expected[i].Id);
+        EXPECT_EQ(trades[i].Qty, expected[i].Qty);
+        EXPECT_EQ(trades[i].Instrument, expected[i].Instrument);
+    }
+}
+
+TEST(MarketDataSorterTests, SortedAndRuns)
+{
+    std::vector<MDTrade> trades(1000, MDTrade());
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        trades[i].EventTimestamp = i / 3;
+        trades[i].Instrument = std::to_string(i);
+    }
+    ExpectSortedLikeStableSort(trades, 1);
+
+    // Ten files appended one after another
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        trades[i].EventTimestamp = (i % 100) * 7 + i / 100;
+        trades[i].Id = i % 2;
+    }
+    ExpectSortedLikeStableSort(trades, 1);
+}
+
+TEST(MarketDataSorterTests, RadixSort)
+{
+    std::mt19937_64 rng(7);
+    for (size_t threads : {1, 4})
+    {
+        std::vector<MDTrade> trades(300000, MDTrade());
+        for (auto &trade : trades)
+        {
+            trade.EventTimestamp = 1700000000000000000ull + rng() % 100000000;
+            trade.Id = rng() % 4;
+            trade.Instrument = "X";
+        }
+        ExpectSortedLikeStableSort(trades, threads);
+    }
+}
+
+TEST(MarketDataSorterTests, CustomUpdates)
+{
+    std::vector<MDCustomMultipleUpdate> updates(200, MDCustomMultipleUpdate());
+    for (size_t i = 0; i < updates.size(); ++i)
+    {
+        updates[i].EventTimestamp = (i * 7919) % 200;
+        updates[i].Payload["value"] = updates[i].EventTimestamp;
+    }
+    MarketDataSorter::Sort(updates, 2);
+    for (size_t i = 0; i < updates.size(); ++i)
+    {
+        EXPECT_EQ(updates[i].EventTimestamp, i);
+        EXPECT_EQ(updates[i].Payload["value"], i);
+    }
+}
@@ -190,4 +190,259 @@ TEST(OrderExecutionManagerTests, MarketOrdersAlwaysMatch)
     delete buyMarket;
     delete sellMarket;
     delete instrument;
-}
\ No newline at end of file
+}
+
+// Cancels unlink orders from the middle, head and tail of a level and release empty levels,
+// the remaining orders fill in arrival order.
+TEST(OrderExecutionManagerTests, CancelKeepsLevelOrder)
+{
+    OrderExecutionManager manager;
+    std::vector<Order> orders(6);
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        orders[i].Id = i;
+        orders[i].Type = OrderType::Limit;
+        orders[i].OrderSide = Side::Buy;
+        orders[i].Price = i < 4 ? 100.0 : 99.0;
+        orders[i].Qty = 1;
+        manager.AddNewOrder(&orders[i]);
+    }
+    EXPECT_EQ(manager.GetBestBid(), 100.0);
+    EXPECT_FALSE(manager.GetBestAsk().has_value());
+
+    manager.CancelOrder(&orders[1]);
+    manager.CancelOrder(&orders[0]);
+    manager.CancelOrder(&orders[3]);
+    manager.CancelOrder(&orders[3]);
+    EXPECT_EQ(manager.GetBestBid(), 100.0);
+
+    manager.CancelOrder(&orders[2]);
+    EXPECT_EQ(manager.GetBestBid(), 99.0);
+
+    // The emptied level is reused
+    manager.AddNewOrder(&orders[0]);
+    EXPECT_EQ(manager.GetBestBid(), 100.0);
+
+    auto executed = manager.MatchWithPrice(99.0, Side::Sell);
+    ASSERT_EQ(executed.size(), 3u);
+    EXPECT_EQ(executed[0]->Id, 0);
+    EXPECT_EQ(executed[1]->Id, 4);
+    EXPECT_EQ(executed[2]->Id, 5);
+    EXPECT_FALSE(manager.GetBestBid().has_value());
+
+    // Filled orders are no longer in the book
+    manager.CancelOrder(&orders[4]);
+    EXPECT_TRUE(manager.MatchWithPrice(0.0, Side::Sell).empty());
+}
+
+// A smaller quantity keeps the place in the level, a larger quantity or a new price
+// sends the order to the back of its level.
+TEST(OrderExecutionManagerTests, ReplaceOrderPriority)
+{
+    OrderExecutionManager manager;
+    std::vector<Order> orders(3);
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        orders[i].Id = i;
+        orders[i].Type = OrderType::Limit;
+        orders[i].OrderSide = Side::Sell;
+        orders[i].Price = 100.0;
+        orders[i].Qty = 5;
+        manager.AddNewOrder(&orders[i]);
+    }
+
+    EXPECT_TRUE(manager.ReplaceOrder(&orders[0], 100.0, 3));
+    EXPECT_TRUE(manager.ReplaceOrder(&orders[1], 100.0, 6));
+    EXPECT_TRUE(manager.ReplaceOrder(&orders[2], 101.0, 5));
+    EXPECT_EQ(orders[0].Qty, 3);
+    EXPECT_EQ(orders[2].Price, 101.0);
+    EXPECT_EQ(manager.GetBestAsk(), 100.0);
+
+    auto executed = manager.MatchWithPrice(100.0, Side::Buy);
+    ASSERT_EQ(executed.size(), 2u);
+    EXPECT_EQ(executed[0]->Id, 0);
+    EXPECT_EQ(executed[1]->Id, 1);
+    EXPECT_FALSE(manager.ReplaceOrder(&orders[0], 99.0, 3));
+    EXPECT_EQ(orders[0].Price, 100.0);
+
+    // Below the last buy print at 100 the amended sell becomes a market order
+    EXPECT_TRUE(manager.ReplaceOrder(&orders[2], 99.0, 5));
+    EXPECT_EQ(orders[2].Type, OrderType::Market);
+    EXPECT_EQ(manager.GetBestAsk(), 0.0);
+    executed = manager.MatchWithPrice(99.5, Side::Buy);
+    ASSERT_EQ(executed.size(), 1u);
+    EXPECT_EQ(executed[0]->LastExecPrice, 99.5);
+}
+
+// A print fills resting orders in priority order up to its quantity.
+TEST(OrderExecutionManagerTests, PartialFillsByQuantity)
+{
+    OrderExecutionManager manager;
+    std::vector<Order> orders(3);
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        orders[i].Id = i;
+        orders[i].Type = OrderType::Limit;
+        orders[i].OrderSide = Side::Buy;
+        orders[i].Price = i == 0 ? 101.0 : 100.0;
+        orders[i].Qty = 2;
+        manager.AddNewOrder(&orders[i]);
+    }
+
+    std::vector<OrderFill> fills;
+    manager.MatchWithPrice(100.0, Side::Sell, 3, fills);
+    ASSERT_EQ(fills.size(), 2u);
+    EXPECT_EQ(fills[0].Order, &orders[0]);
+    EXPECT_EQ(fills[0].Qty, 2);
+    EXPECT_EQ(fills[0].Price, 101.0);
+    EXPECT_EQ(fills[0].FilledQty, 2);
+    EXPECT_EQ(fills[1].Order, &orders[1]);
+    EXPECT_EQ(fills[1].Qty, 1);
+    EXPECT_EQ(fills[1].FilledQty, 1);
+    EXPECT_EQ(manager.GetBestBid(), 100.0);
+
+    // The partially filled order keeps its place and can only grow above its filled quantity
+    EXPECT_FALSE(manager.ReplaceOrder(&orders[1], 100.0, 1));
+    EXPECT_TRUE(manager.ReplaceOrder(&orders[1], 100.0, 1.5));
+
+    fills.clear();
+    manager.MatchWithPrice(99.0, Side::Sell, 10, fills);
+    ASSERT_EQ(fills.size(), 2u);
+    EXPECT_EQ(fills[0].Order, &orders[1]);
+    EXPECT_EQ(fills[0].Qty, 0.5);
+    EXPECT_EQ(fills[0].FilledQty, 1.5);
+    EXPECT_EQ(fills[1].Order, &orders[2]);
+    EXPECT_EQ(fills[1].Qty, 2);
+    EXPECT_FALSE(manager.GetBestBid().has_value());
+}
+
+// With the queue position model an order fills once the displayed quantity ahead of it has
+// printed or been canceled, prints through its price fill it regardless.
+TEST(OrderExecutionManagerTests, QueuePositionModel)
+{
+    OrderExecutionManager manager;
+    manager.SetQueuePositionModel(true);
+    std::vector<Order> orders(3);
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        orders[i].Id = i;
+        orders[i].Type = OrderType::Limit;
+        orders[i].OrderSide = Side::Sell;
+        orders[i].Price = i < 2 ? 101.0 : 103.0;
+        orders[i].Qty = i == 0 ? 2 : 1;
+    }
+    manager.AddNewOrder(&orders[0], 5);
+
+    std::vector<OrderFill> fills;
+    manager.MatchWithPrice(101.0, Side::Buy, 3, fills);
+    EXPECT_TRUE(fills.empty());
+
+    // 1 of the 2 missing lots was canceled, 1 lot is left ahead of the order
+    manager.UpdateDisplayedQty(Side::Sell, 101.0, 1);
+    manager.AddNewOrder(&orders[1], 1);
+    manager.MatchWithPrice(101.0, Side::Buy, 2, fills);
+    ASSERT_EQ(fills.size(), 1u);
+    EXPECT_EQ(fills[0].Order, &orders[0]);
+    EXPECT_EQ(fills[0].Qty, 1);
+
+    fills.clear();
+    manager.MatchWithPrice(101.0, Side::Buy, 1, fills);
+    ASSERT_EQ(fills.size(), 1u);
+    EXPECT_EQ(fills[0].Order, &orders[0]);
+    EXPECT_EQ(fills[0].FilledQty, 2);
+
+    fills.clear();
+    manager.MatchWithPrice(102.0, Side::Buy, 5, fills);
+    ASSERT_EQ(fills.size(), 1u);
+    EXPECT_EQ(fills[0].Order, &orders[1]);
+
+    // The top of the market moving behind the level leaves nothing ahead
+    manager.AddNewOrder(&orders[2], 4);
+    manager.UpdateDisplayedTop(Side::Sell, 104.0, 2);
+    fills.clear();
+    manager.MatchWithPrice(103.0, Side::Buy, 1, fills);
+    ASSERT_EQ(fills.size(), 1u);
+    EXPECT_EQ(fills[0].Order, &orders[2]);
+}
+
+TEST(OrderExecutionManagerTests, QueuePositionDepthUpdates)
+{
+    OrderExecutionManager manager;
+    manager.SetQueuePositionModel(true);
+    std::vector<Order> orders(3);
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        orders[i].Id = i;
+        orders[i].Type = OrderType::Limit;
+        orders[i].OrderSide = i < 2 ? Side::Buy : Side::Sell;
+        orders[i].Price = i == 0 ? 99.0 : i == 1 ? 98.0 : 101.0;
+        orders[i].Qty = 1;
+    }
+    manager.AddNewOrder(&orders[0], 3);
+    manager.AddNewOrder(&orders[1], 2);
+    manager.AddNewOrder(&orders[2], 4);
+
+    // A delta touches only its levels, 98 keeps 2 lots ahead
+    std::vector<MDL2Level> bids{{99.0, 1}};
+    MDL2Update delta;
+    delta.Bid = bids;
+    manager.UpdateDisplayedDepth(delta);
+
+    std::vector<OrderFill> fills;
+    manager.MatchWithPrice(99.0, Side::Sell, 1, fills);
+    EXPECT_TRUE(fills.empty());
+    manager.MatchWithPrice(99.0, Side::Sell, 1, fills);
+    ASSERT_EQ(fills.size(), 1u);
+    EXPECT_EQ(fills[0].Order, &orders[0]);
+
+    // Our levels missing from a snapshot have nothing ahead
+    std::vector<MDL2Level> snapshotBids{{97.0, 5}}, snapshotAsks{{100.0, 3}, {102.0, 1}};
+    MDL2Update snapshot;
+    snapshot.Bid = snapshotBids;
+    snapshot.Ask = snapshotAsks;
+    snapshot.Snapshot = true;
+    manager.UpdateDisplayedDepth(snapshot);
+
+    fills.clear();
+    manager.MatchWithPrice(98.0, Side::Sell, 1, fills);
+    ASSERT_EQ(fills.size(), 1u);
+    EXPECT_EQ(fills[0].Order, &orders[1]);
+    fills.clear();
+    manager.MatchWithPrice(101.0, Side::Buy, 1, fills);
+    ASSERT_EQ(fills.size(), 1u);
+    EXPECT_EQ(fills[0].Order, &orders[2]);
+}
+
+// Rounding leftovers of fractional quantities neither keep an order in the book nor fill the
+// next one.
+TEST(OrderExecutionManagerTests, FractionalQuantities)
+{
+    OrderExecutionManager manager;
+    std::vector<Order> orders(3);
+    for (size_t i = 0; i < orders.size(); ++i)
+    {
+        orders[i].Id = i;
+        orders[i].Type = OrderType::Limit;
+        orders[i].OrderSide = Side::Buy;
+        orders[i].Price = i < 2 ? 100.0 : 99.0;
+        orders[i].Qty = i == 0 ? 0.1 : 0.2;
+        manager.AddNewOrder(&orders[i]);
+    }
+
+    std::vector<OrderFill> fills;
+    manager.MatchWithPrice(100.0, Side::Sell, 0.3, fills);
+    ASSERT_EQ(fills.size(), 2u);
+    EXPECT_EQ(fills[0].FilledQty, orders[0].Qty);
+    EXPECT_EQ(fills[1].FilledQty, orders[1].Qty);
+    EXPECT_EQ(orders[1].BookQty, 0);
+    EXPECT_EQ(manager.GetBestBid(), 99.0);
+
+    fills.clear();
+    manager.MatchWithPrice(99.0, Side::Sell, 0.1 + 0.2 - 0.3, fills);
+    EXPECT_TRUE(fills.empty());
+
+    manager.MatchWithPrice(99.0, Side::Sell, 0.7 - 0.5, fills);
+    ASSERT_EQ(fills.size(), 1u);
+    EXPECT_EQ(fills[0].FilledQty, orders[2].Qty);
+    EXPECT_FALSE(manager.GetBestBid().has_value());
+}
@@ -134,6 +134,87 @@ TEST(SimulationTests, LimitBuyOrderExecutionTest) {
     delete order;
 }
 
+TEST(SimulationTests, JournalRecordsOrderEventsTest) {
+    g_executedOrders.clear();
+    g_canceledOrders.clear();
+    g_newOrders.clear();
+    g_mdTrades.clear();
+    g_mdL1Updates.clear();
+
+    auto dir = std::filesystem::temp_directory_path() / ("crpt_journal_" + Helpers::GetRandomString(8));
+    std::filesystem::create_directories(dir);
+    std::string path = (dir / "orders.jrn").string();
+
+    CSVMarketDataTradesManager dataCollection({"../../data/simulation_test_trades_3.csv"});
+    auto row = dataCollection.GetTrades();
+    MarketDataSimulationManager marketDataManager({MDRow{row}});
+    Simulation<10> sim(marketDataManager, 10, 5,
+        ExecutedOrderCallback,
+        CanceledOrderCallback,
+        ReplacedOrderCallback,
+        NewOrderCallback,
+        MDTradeCallback,
+        MDL1UpdateCallback,
+        MDCustomUpdateCallback);
+
+    // A tiny ring forces the simulation to wait for the writer
+    Journal journal(path, 1);
+    sim.SetJournal(&journal);
+
+    OrderPtr order = new Order();
+    order->Id = 101;
+    order->OrderSide = Side::Buy;
+    order->Type = OrderType::Limit;
+    order->Price = 100;
+    order->Qty = 50;
+    order->Instrument = "TestInstrument";
+    sim.OnNewOrder(order);
+
+    sim.Run();
+    journal.Close();
+    ASSERT_EQ(g_executedOrders.size(), 1u);
+
+    JournalReader reader(path);
+    auto records = reader.Records();
+    ASSERT_EQ(records.size(), 2u);
+    ASSERT_EQ(reader.GetInstruments(), std::vector<std::string>{"TestInstrument"});
+    EXPECT_EQ(records[0].Event, JournalEvent::New);
+    EXPECT_EQ(records[1].Event, JournalEvent::Filled);
+    EXPECT_EQ(records[1].Id, 101);
+    EXPECT_EQ(records[1].Instrument, 0u);
+    EXPECT_EQ(records[1].OrderSide, Side::Buy);
+    EXPECT_EQ(OrderState(records[1].State), OrderState::Filled);
+    EXPECT_EQ(records[1].EventTimestamp, order->LastReportTimestamp);
+    EXPECT_DOUBLE_EQ(records[1].Qty, 50);
+
+    reader.ToCSV((dir / "orders.csv").string());
+    std::ifstream csv(dir / "orders.csv");
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(csv, line))
+        ++lines;
+    EXPECT_EQ(lines, 3u);
+
+    reader.ToColumns((dir / "columns").string());
+    EXPECT_EQ(std::filesystem::file_size(dir / "columns" / "order_id.bin"), 2 * sizeof(OrderId));
+    EXPECT_EQ(std::filesystem::file_size(dir / "columns" / "event_timestamp.bin"), 2 * sizeof(Timestamp));
+    EXPECT_TRUE(std::filesystem::exists(dir / "columns" / "instruments.txt"));
+
+    std::filesystem::remove_all(dir);
+    delete order;
+}
+
+TEST(SimulationTests, JournalWriteFailureTest) {
+    // Every write to /dev/full fails for lack of space
+    Journal journal("/dev/full", 4);
+    Order order;
+    order.Id = 1;
+    order.Instrument = "TestInstrument";
+    for (int i = 0; i < 10000; ++i)
+        journal.Record(JournalEvent::New, order, i);
+    EXPECT_THROW(journal.Close(), std::runtime_error);
+}
+
 TEST(SimulationTests, LimitSellOrderExecutionTest) {
     g_executedOrders.clear();
     g_canceledOrders.clear();
@@ -532,7 +613,7 @@ TEST(SimulationTests, LimitOrderExecutedAgainstL1Test) {
         {
         }
 
-        void onL1Update(MDL1UpdatePtr update)
+        void onL1Update(MDL1UpdatePtr)
         {
             ++count;
             if (count == 3)
@@ -611,7 +692,7 @@ TEST(SimulationTests, LimitOrderCanceledL1Test) {
         {
         }
 
-        void onL1Update(MDL1UpdatePtr update)
+        void onL1Update(MDL1UpdatePtr)
         {
             ++count;
             if (count == 1)
@@ -649,4 +730,589 @@ TEST(SimulationTests, LimitOrderCanceledL1Test) {
     } sim(marketDataManager);
     sim.Run();
     ASSERT_EQ(g_executedOrders.size(), 0u);
-}
\ No newline at end of file
+}
+
+TEST(SimulationTests, NextTimestampTest) {
+    std::vector<MDCustomUpdate> updates1(5, MDCustomUpdate());
+    std::vector<MDCustomUpdate> updates2(5, MDCustomUpdate());
+    for (size_t i = 0; i < updates1.size(); ++i)
+        updates1[i].EventTimestamp = i*3;
+    for (size_t i = 0; i < updates2.size(); ++i)
+        updates2[i].EventTimestamp = i * 3 + 1;
+
+    MarketDataSimulationManager marketDataManager({MDRow{updates1}, MDRow{updates2}});
+
+    std::vector<std::pair<Timestamp, Timestamp>> observed;
+    struct Sim
+    {
+        Simulation<10> sim;
+        std::vector<std::pair<Timestamp, Timestamp>> &observed;
+
+        Sim(MarketDataSimulationManager &mdManager, std::vector<std::pair<Timestamp, Timestamp>> &observed)
+            : sim(mdManager, 0, 0, ExecutedOrderCallback, CanceledOrderCallback, ReplacedOrderCallback, NewOrderCallback, MDTradeCallback,
+                  MDL1UpdateCallback,
+                  [this](MDCustomUpdatePtr)
+                  { this->observed.emplace_back(sim.GetCurrentTimestamp(), sim.GetNextTimestamp()); }),
+              observed(observed)
+        {
+        }
+    } sim(marketDataManager, observed);
+    sim.sim.Run();
+
+    ASSERT_EQ(observed.size(), 10u);
+    for (size_t i = 0; i + 1 < observed.size(); ++i)
+    {
+        EXPECT_EQ(observed[i].second, observed[i + 1].first);
+    }
+}
+
+TEST(SimulationTests, ExecuteOrderColumnarTradesTest) {
+    g_executedOrders.clear();
+    g_mdTrades.clear();
+
+    CSVMarketDataTradesManager dataCollection({"../../data/simulation_test_trades_5.csv"});
+    auto columns = std::make_shared<MDTradeColumns>(dataCollection.GetTrades());
+    MarketDataSimulationManager marketDataManager({MDRow(columns)});
+
+    Simulation<10> sim(marketDataManager, 0, 0,
+        ExecutedOrderCallback,
+        CanceledOrderCallback,
+        ReplacedOrderCallback,
+        NewOrderCallback,
+        MDTradeCallback,
+        MDL1UpdateCallback,
+        MDCustomUpdateCallback);
+
+    OrderPtr order = new Order();
+    order->Id = 1;
+    order->OrderSide = Side::Buy;
+    order->Type = OrderType::Market;
+    order->Qty = 10;
+    order->Instrument = "TestInstrument";
+    sim.OnNewOrder(order);
+    sim.Run();
+
+    ASSERT_EQ(g_executedOrders.size(), 1u);
+    EXPECT_EQ(g_executedOrders[0]->LastExecPrice, 105);
+    EXPECT_EQ(g_executedOrders[0]->LastReportTimestamp, 15);
+    EXPECT_EQ(g_mdTrades.size(), 6u);
+
+    delete order;
+}
+
+TEST(SimulationTests, BatchedSameTimestampTest) {
+    g_executedOrders.clear();
+    g_mdTrades.clear();
+
+    std::vector<MDTrade> trades;
+    for (int i = 0; i < 12; ++i)
+    {
+        MDTrade trade;
+        trade.EventTimestamp = 10 * (i / 4);
+        trade.Price = 100 - i;
+        trade.Qty = 1;
+        trade.AggressorSide = Side::Sell;
+        trade.Instrument = "TestInstrument";
+        trades.push_back(trade);
+    }
+    std::vector<MDCustomUpdate> updates(3, MDCustomUpdate());
+    for (size_t i = 0; i < updates.size(); ++i)
+        updates[i].EventTimestamp = 10 * i;
+
+    MarketDataSimulationManager marketDataManager({MDRow{trades}, MDRow{updates}});
+
+    struct Sim
+    {
+        Simulation<100> sim;
+        std::vector<std::vector<MarketDataUpdatePtr>> batches;
+        std::vector<Timestamp> nextTimestamps;
+        OrderPtr order{nullptr};
+
+        Sim(MarketDataSimulationManager &mdManager)
+            : sim(mdManager, 0, 0, ExecutedOrderCallback, CanceledOrderCallback, ReplacedOrderCallback, NewOrderCallback,
+                  MDTradeCallback, MDL1UpdateCallback, MDCustomUpdateCallback)
+        {
+            sim.SetBatchCallback([this](std::span<const MarketDataUpdatePtr> batch)
+                                 { onBatch(batch); });
+        }
+
+        void onBatch(std::span<const MarketDataUpdatePtr> batch)
+        {
+            batches.emplace_back(batch.begin(), batch.end());
+            nextTimestamps.push_back(sim.GetNextTimestamp());
+            if (order == nullptr)
+            {
+                order = new Order();
+                order->Id = 1;
+                order->OrderSide = Side::Buy;
+                order->Type = OrderType::Limit;
+                order->Price = 95;
+                order->Qty = 1;
+                order->Instrument = "TestInstrument";
+                sim.OnNewOrder(order);
+            }
+        }
+    } sim(marketDataManager);
+    sim.sim.Run();
+
+    ASSERT_EQ(sim.batches.size(), 3u);
+    for (size_t i = 0; i < sim.batches.size(); ++i)
+    {
+        EXPECT_EQ(sim.batches[i].size(), 5u);
+        for (auto update : sim.batches[i])
+            EXPECT_EQ(update->EventTimestamp, 10 * i);
+    }
+    EXPECT_EQ(sim.nextTimestamps[0], 10u);
+    EXPECT_EQ(sim.nextTimestamps[1], 20u);
+    EXPECT_TRUE(g_mdTrades.empty());
+
+    ASSERT_EQ(g_executedOrders.size(), 1u);
+    EXPECT_EQ(g_executedOrders[0]->LastReportTimestamp, 10u);
+    delete sim.order;
+}
+
+TEST(SimulationTests, BatchedColumnarTradesTest) {
+    g_executedOrders.clear();
+    g_mdTrades.clear();
+
+    std::vector<MDTrade> trades;
+    for (int i = 0; i < 12; ++i)
+    {
+        MDTrade trade;
+        trade.EventTimestamp = 10 * (i / 4);
+        trade.Price = 100 - i;
+        trade.Qty = 1;
+        trade.AggressorSide = Side::Sell;
+        trade.Instrument = "TestInstrument";
+        trades.push_back(trade);
+    }
+    MarketDataSimulationManager marketDataManager({MDRow(std::make_shared<MDTradeColumns>(trades))});
+
+    // Trades are materialized for the batch and copied out, they don't outlive the callback
+    std::vector<MDTrade> delivered;
+    Simulation<100> sim(marketDataManager, 0, 5, ExecutedOrderCallback, CanceledOrderCallback, ReplacedOrderCallback,
+                        NewOrderCallback, MDTradeCallback, MDL1UpdateCallback, MDCustomUpdateCallback);
+    sim.SetBatchCallback([&](std::span<const MarketDataUpdatePtr> batch)
+                         {
+                             for (auto update : batch)
+                                 delivered.push_back(*MDTradePtr(update)); });
+
+    OrderPtr order = new Order();
+    order->Id = 1;
+    order->OrderSide = Side::Buy;
+    order->Type = OrderType::Limit;
+    order->Price = 95;
+    order->Qty = 1;
+    order->Instrument = "TestInstrument";
+    sim.OnNewOrder(order);
+    sim.Run();
+
+    // The last group is delivered after the data ends, past the market data latency
+    ASSERT_EQ(delivered.size(), 8u);
+    for (size_t i = 0; i < delivered.size(); ++i)
+    {
+        EXPECT_EQ(delivered[i].Price, trades[i].Price);
+        EXPECT_EQ(delivered[i].Instrument, "TestInstrument");
+        EXPECT_EQ(delivered[i].LocalTimestamp, trades[i].EventTimestamp + 5);
+    }
+    EXPECT_TRUE(g_mdTrades.empty());
+
+    ASSERT_EQ(g_executedOrders.size(), 1u);
+    EXPECT_EQ(g_executedOrders[0]->LastExecPrice, 95);
+    EXPECT_EQ(g_executedOrders[0]->LastReportTimestamp, 10u);
+    delete order;
+}
+
+TEST(SimulationTests, ReplaceOrderTest) {
+    g_executedOrders.clear();
+    g_replacedOrders.clear();
+
+    std::vector<MDTrade> trades;
+    for (int i = 1; i <= 10; ++i)
+    {
+        MDTrade trade;
+        trade.EventTimestamp = 10 * i;
+        trade.Price = 105;
+        trade.Qty = 1;
+        trade.AggressorSide = Side::Buy;
+        trade.Instrument = "TestInstrument";
+        trades.push_back(trade);
+    }
+    MarketDataSimulationManager marketDataManager({MDRow{trades}});
+
+    // Amends the quote once acknowledged, then moves it through the market
+    struct Sim
+    {
+        Simulation<10> sim;
+        Order order;
+        std::vector<std::tuple<double, double, Timestamp>> replaced;
+
+        Sim(MarketDataSimulationManager &mdManager)
+            : sim(mdManager, 10, 0, ExecutedOrderCallback, CanceledOrderCallback,
+                  [this](OrderPtr order) { onReplaced(order); },
+                  [this](OrderPtr order) { sim.OnOrderReplace(order, 108, 1); },
+                  MDTradeCallback, MDL1UpdateCallback, MDCustomUpdateCallback)
+        {
+            order.Id = 1;
+            order.OrderSide = Side::Sell;
+            order.Type = OrderType::Limit;
+            order.Price = 110;
+            order.Qty = 2;
+            order.Instrument = "TestInstrument";
+            sim.OnNewOrder(&order);
+        }
+
+        void onReplaced(OrderPtr order)
+        {
+            ReplacedOrderCallback(order);
+            replaced.emplace_back(order->Price, order->Qty, order->LastReportTimestamp);
+            sim.OnOrderReplace(order, 104, 1);
+        }
+    } sim(marketDataManager);
+    sim.sim.Run();
+
+    // The second amend crosses the last buy print at 105 and becomes a market order, its
+    // acknowledgement comes before the fill it gets
+    ASSERT_EQ(sim.replaced.size(), 2u);
+    EXPECT_EQ(sim.replaced[0], std::make_tuple(108.0, 1.0, Timestamp(30)));
+    EXPECT_EQ(sim.replaced[1], std::make_tuple(0.0, 1.0, Timestamp(50)));
+
+    ASSERT_EQ(g_executedOrders.size(), 1u);
+    EXPECT_EQ(g_executedOrders[0]->LastExecPrice, 105);
+    EXPECT_EQ(g_executedOrders[0]->FilledQty, 1);
+    EXPECT_EQ(g_executedOrders[0]->LastReportTimestamp, 50u);
+}
+
+TEST(SimulationTests, ReplaceHoldsOnlyAmendedOrderFillsTest) {
+    std::vector<MDTrade> trades;
+    for (int i = 1; i <= 8; ++i)
+    {
+        MDTrade trade;
+        trade.EventTimestamp = 10 * i;
+        trade.Price = i <= 3 ? 100 : 105;
+        trade.Qty = 1;
+        trade.AggressorSide = Side::Buy;
+        trade.Instrument = "TestInstrument";
+        trades.push_back(trade);
+    }
+    MarketDataSimulationManager marketDataManager({MDRow{trades}});
+
+    // Two resting orders filled by the same print, the first one with an amend in flight
+    struct Sim
+    {
+        Simulation<10> sim;
+        std::vector<Order> orders{2};
+        std::vector<std::pair<UpdateId, Timestamp>> reports;
+
+        Sim(MarketDataSimulationManager &mdManager)
+            : sim(mdManager, 10, 0,
+                  [this](OrderPtr order) { reports.emplace_back(order->Id, order->LastReportTimestamp); },
+                  CanceledOrderCallback,
+                  [this](OrderPtr order) { reports.emplace_back(order->Id, order->LastReportTimestamp); },
+                  NewOrderCallback,
+                  [this](MDTradePtr trade)
+                  {
+                      if (trade->EventTimestamp == 30)
+                          sim.OnOrderReplace(&orders[0], 104, 1);
+                  },
+                  MDL1UpdateCallback, MDCustomUpdateCallback)
+        {
+            for (size_t i = 0; i < orders.size(); ++i)
+            {
+                orders[i].Id = i + 1;
+                orders[i].OrderSide = Side::Sell;
+                orders[i].Type = OrderType::Limit;
+                orders[i].Price = 104;
+                orders[i].Qty = 2;
+                orders[i].Instrument = "TestInstrument";
+                sim.OnNewOrder(&orders[i]);
+            }
+        }
+    } sim(marketDataManager);
+    sim.sim.Run();
+
+    // The second order's fill isn't held behind the first order's amend
+    std::vector<std::pair<UpdateId, Timestamp>> expected{{2, 40}, {1, 50}, {1, 50}};
+    EXPECT_EQ(sim.reports, expected);
+    EXPECT_EQ(sim.orders[0].State, OrderState::Filled);
+    EXPECT_EQ(sim.orders[0].FilledQty, 1);
+    EXPECT_EQ(sim.orders[1].State, OrderState::Filled);
+}
+
+TEST(SimulationTests, PartialFillsTest) {
+    g_executedOrders.clear();
+
+    CSVMarketDataTradesManager dataCollection({"../../data/simulation_test_trades_5.csv"});
+    auto trades = dataCollection.GetTrades();
+    trades[3].Qty = 2;
+    MarketDataSimulationManager marketDataManager({MDRow{trades}});
+    std::vector<std::tuple<OrderState, double, Timestamp>> fills;
+    Simulation<10> sim(marketDataManager, 0, 0,
+        [&](OrderPtr order) { fills.emplace_back(order->State, order->FilledQty, order->LastReportTimestamp); },
+        CanceledOrderCallback,
+        ReplacedOrderCallback,
+        NewOrderCallback,
+        MDTradeCallback,
+        MDL1UpdateCallback,
+        MDCustomUpdateCallback);
+    sim.SetPartialFills(true);
+
+    // Sell prints at 95 and 105, then buy prints of 1, 1, 2 and 1 at 105
+    Order order;
+    order.Id = 1;
+    order.OrderSide = Side::Sell;
+    order.Type = OrderType::Limit;
+    order.Price = 100;
+    order.Qty = 3.5;
+    order.Instrument = "TestInstrument";
+    sim.OnNewOrder(&order);
+    sim.Run();
+
+    ASSERT_EQ(fills.size(), 3u);
+    EXPECT_EQ(fills[0], std::make_tuple(OrderState::PartiallyFilled, 1.0, Timestamp(45)));
+    EXPECT_EQ(fills[1], std::make_tuple(OrderState::PartiallyFilled, 3.0, Timestamp(55)));
+    EXPECT_EQ(fills[2], std::make_tuple(OrderState::Filled, 3.5, Timestamp(65)));
+    EXPECT_EQ(order.LastExecPrice, 100);
+}
+
+TEST(SimulationTests, PartialFillsAgainstL1Test) {
+    // The ask shows 1 at 100 for 15 updates, then 3
+    std::vector<MDL1Update> updates(20);
+    for (size_t i = 0; i < updates.size(); ++i)
+    {
+        updates[i].EventTimestamp = i;
+        updates[i].AskPrice = 100;
+        updates[i].AskQty = i < 15 ? 1 : 3;
+        updates[i].BidPrice = 90;
+        updates[i].BidQty = 1;
+        updates[i].Instrument = "TestInstrument";
+    }
+    MarketDataSimulationManager marketDataManager({MDRow{updates}});
+    std::vector<std::tuple<OrderState, double, Timestamp>> fills;
+    Simulation<10> sim(marketDataManager, 0, 0,
+        [&](OrderPtr order) { fills.emplace_back(order->State, order->FilledQty, order->LastReportTimestamp); },
+        CanceledOrderCallback,
+        ReplacedOrderCallback,
+        NewOrderCallback,
+        MDTradeCallback,
+        MDL1UpdateCallback,
+        MDCustomUpdateCallback);
+    sim.SetPartialFills(true);
+
+    Order order;
+    order.Id = 1;
+    order.OrderSide = Side::Buy;
+    order.Type = OrderType::Limit;
+    order.Price = 100;
+    order.Qty = 10;
+    order.Instrument = "TestInstrument";
+    sim.OnNewOrder(&order);
+    sim.Run();
+
+    ASSERT_EQ(fills.size(), 2u);
+    EXPECT_EQ(fills[0], std::make_tuple(OrderState::PartiallyFilled, 1.0, Timestamp(0)));
+    EXPECT_EQ(fills[1], std::make_tuple(OrderState::PartiallyFilled, 3.0, Timestamp(15)));
+}
+
+TEST(SimulationTests, ExecuteOrderAgainstL2Test) {
+    for (bool partialFills : {false, true})
+    {
+        g_executedOrders.clear();
+
+        CSVMarketDataL2Manager depth({"../../data/simulation_test_depth_0.csv"});
+        MarketDataSimulationManager marketDataManager({MDRow{depth.GetUpdates()}});
+        Simulation<10> sim(marketDataManager, 0, 0,
+            ExecutedOrderCallback,
+            CanceledOrderCallback,
+            ReplacedOrderCallback,
+            NewOrderCallback,
+            MDTradeCallback,
+            MDL1UpdateCallback,
+            MDCustomUpdateCallback);
+        L2Book book;
+        size_t updates = 0;
+        sim.SetL2UpdateCallback([&](MDL2UpdatePtr update) {
+            ++updates;
+            book.Apply(*update);
+        });
+        sim.SetPartialFills(partialFills);
+
+        // Only the ask of 1 at 99.5 at 30 crosses the bid
+        Order order;
+        order.Id = 1;
+        order.OrderSide = Side::Buy;
+        order.Type = OrderType::Limit;
+        order.Price = 100;
+        order.Qty = 2;
+        order.Instrument = "TestInstrument";
+        sim.OnNewOrder(&order);
+        sim.Run();
+
+        EXPECT_EQ(updates, 4u);
+        EXPECT_EQ(book.GetBestBid(), 99.5);
+        ASSERT_EQ(g_executedOrders.size(), 1u);
+        EXPECT_EQ(order.LastReportTimestamp, 30u);
+        EXPECT_EQ(order.LastExecPrice, 100);
+        EXPECT_EQ(order.FilledQty, partialFills ? 1 : 2);
+        EXPECT_EQ(order.State, partialFills ? OrderState::PartiallyFilled : OrderState::Filled);
+    }
+}
+
+TEST(SimulationTests, PartialFillsAgainstL2Test) {
+    // The crossing ask of 1 at 99.5 stays unchanged at 20 and 30, and shows 3 at 40
+    std::vector<MDL2Level> asks{{101, 2}, {99.5, 1}}, bids{{98, 5}}, asks30{{101, 4}}, asks40{{99.5, 3}};
+    std::vector<MDL2Update> updates(4);
+    for (size_t i = 0; i < updates.size(); ++i)
+    {
+        updates[i].EventTimestamp = 10 * (i + 1);
+        updates[i].Instrument = "TestInstrument";
+    }
+    updates[0].Snapshot = true;
+    updates[0].Ask = asks;
+    updates[1].Bid = bids;
+    updates[2].Ask = asks30;
+    updates[3].Ask = asks40;
+    MarketDataSimulationManager marketDataManager({MDRow{updates}});
+    std::vector<std::tuple<OrderState, double, Timestamp>> fills;
+    Simulation<10> sim(marketDataManager, 0, 0,
+        [&](OrderPtr order) { fills.emplace_back(order->State, order->FilledQty, order->LastReportTimestamp); },
+        CanceledOrderCallback,
+        ReplacedOrderCallback,
+        NewOrderCallback,
+        MDTradeCallback,
+        MDL1UpdateCallback,
+        MDCustomUpdateCallback);
+    sim.SetPartialFills(true);
+
+    Order order;
+    order.Id = 1;
+    order.OrderSide = Side::Buy;
+    order.Type = OrderType::Limit;
+    order.Price = 100;
+    order.Qty = 10;
+    order.Instrument = "TestInstrument";
+    sim.OnNewOrder(&order);
+    sim.Run();
+
+    ASSERT_EQ(fills.size(), 2u);
+    EXPECT_EQ(fills[0], std::make_tuple(OrderState::PartiallyFilled, 1.0, Timestamp(10)));
+    EXPECT_EQ(fills[1], std::make_tuple(OrderState::PartiallyFilled, 3.0, Timestamp(40)));
+}
+
+TEST(SimulationTests, QueuePositionModelTest) {
+    for (bool queuePositions : {false, true})
+    {
+        g_executedOrders.clear();
+
+        std::vector<MDL1Update> quotes(1);
+        quotes[0].EventTimestamp = 10;
+        quotes[0].BidPrice = 99;
+        quotes[0].BidQty = 5;
+        quotes[0].AskPrice = 101;
+        quotes[0].AskQty = 3;
+        quotes[0].Instrument = "TestInstrument";
+        std::vector<MDTrade> trades(2);
+        for (size_t i = 0; i < trades.size(); ++i)
+        {
+            trades[i].EventTimestamp = 20 + 10 * i;
+            trades[i].Price = 101;
+            trades[i].Qty = 2;
+            trades[i].AggressorSide = Side::Buy;
+            trades[i].Instrument = "TestInstrument";
+        }
+        MarketDataSimulationManager marketDataManager({MDRow{quotes}, MDRow{trades}});
+
+        // Joins the ask of 3 once it is displayed
+        struct Sim
+        {
+            Simulation<10> sim;
+            Order order;
+
+            Sim(MarketDataSimulationManager &mdManager)
+                : sim(mdManager, 0, 0, ExecutedOrderCallback, CanceledOrderCallback, ReplacedOrderCallback,
+                      NewOrderCallback, MDTradeCallback, [this](MDL1UpdatePtr) { sendOrder(); })
+            {
+            }
+
+            void sendOrder()
+            {
+                order.Id = 1;
+                order.OrderSide = Side::Sell;
+                order.Type = OrderType::Limit;
+                order.Price = 101;
+                order.Qty = 1;
+                order.Instrument = "TestInstrument";
+                sim.OnNewOrder(&order);
+            }
+        } sim(marketDataManager);
+        sim.sim.SetPartialFills(true);
+        sim.sim.SetQueuePositionModel(queuePositions);
+        sim.sim.Run();
+
+        ASSERT_EQ(g_executedOrders.size(), 1u);
+        EXPECT_EQ(sim.order.State, OrderState::Filled);
+        EXPECT_EQ(sim.order.LastReportTimestamp, queuePositions ? 30u : 20u);
+    }
+}
+
+TEST(SimulationTests, BatchedBurstLongerThanQueueTest) {
+    std::vector<MDTrade> trades(21);
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        trades[i].EventTimestamp = i < 20 ? 10 : 20;
+        trades[i].Price = 100;
+        trades[i].Qty = 1;
+        trades[i].AggressorSide = Side::Sell;
+        trades[i].Instrument = "TestInstrument";
+    }
+    MarketDataSimulationManager marketDataManager({MDRow{trades}});
+
+    size_t delivered = 0;
+    std::vector<size_t> batches;
+    Simulation<8> sim(marketDataManager, 0, 0,
+        ExecutedOrderCallback,
+        CanceledOrderCallback,
+        ReplacedOrderCallback,
+        NewOrderCallback,
+        MDTradeCallback,
+        MDL1UpdateCallback,
+        MDCustomUpdateCallback);
+    sim.SetThrowOnQueueOverflow(true);
+    sim.SetBatchCallback([&](std::span<const MarketDataUpdatePtr> batch) {
+        delivered += batch.size();
+        batches.push_back(batch.size());
+    });
+    sim.Run();
+
+    EXPECT_EQ(delivered, 21u);
+    EXPECT_EQ(batches, (std::vector<size_t>{20, 1}));
+}
+
+TEST(SimulationTests, QueueOverflowThrowsTest) {
+    std::vector<MDTrade> trades(20);
+    for (size_t i = 0; i < trades.size(); ++i)
+    {
+        trades[i].EventTimestamp = i;
+        trades[i].Price = 100;
+        trades[i].Qty = 1;
+        trades[i].AggressorSide = Side::Sell;
+        trades[i].Instrument = "TestInstrument";
+    }
+    MarketDataSimulationManager marketDataManager({MDRow{trades}});
+
+    // Market data held back by a latency longer than the queue is dropped unless asked to throw
+    Simulation<8> sim(marketDataManager, 0, 100,
+        ExecutedOrderCallback,
+        CanceledOrderCallback,
+        ReplacedOrderCallback,
+        NewOrderCallback,
+        MDTradeCallback,
+        MDL1UpdateCallback,
+        MDCustomUpdateCallback);
+    g_mdTrades.clear();
+    EXPECT_NO_THROW(sim.Run());
+    EXPECT_TRUE(g_mdTrades.empty());
+
+    sim.SetThrowOnQueueOverflow(true);
+    EXPECT_THROW(sim.Run(), std::runtime_error);
+}
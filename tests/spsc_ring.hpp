@@ -0,0 +1,34 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "../src/utils/spsc_ring.hpp"
+
+using namespace CRPT::Utils;
+
+TEST(SPSCRingTests, PushPopBatch)
+{
+    SPSCRing<u_int64_t> ring(1000);
+    EXPECT_EQ(ring.Capacity(), 1024u);
+    EXPECT_TRUE(ring.Empty());
+
+    constexpr u_int64_t COUNT = 1000000;
+    std::thread producer([&]() {
+        for (u_int64_t i = 0; i < COUNT; ++i)
+            while (!ring.TryPush(i))
+                std::this_thread::yield();
+    });
+
+    std::vector<u_int64_t> batch(100);
+    u_int64_t expected = 0;
+    bool ordered = true;
+    while (expected < COUNT)
+    {
+        size_t count = ring.PopBatch(batch.data(), batch.size());
+        for (size_t i = 0; i < count; ++i)
+            ordered &= batch[i] == expected++;
+    }
+    producer.join();
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(ring.Empty());
+}
@@ -1,9 +1,13 @@
 //#pragma once
 
 #include "circular_buffer.hpp"
+#include "spsc_ring.hpp"
 #include "order_execution_manager.hpp"
 #include "market_data_simulation_manager.hpp"
 #include "simulation.hpp"
+#include "market_data_sorter.hpp"
+#include "csv_reader.hpp"
+#include "clickhouse_decoder.hpp"
 //#include "clickhouse_fetcher.hpp"
 
 int main(int argc, char* argv[])